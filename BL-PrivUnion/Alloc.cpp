@@ -0,0 +1,149 @@
+#include "Alloc.h"
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace volePSI
+{
+	u8* AlignedAllocator::allocate(u64 size)
+	{
+		return (u8*)::operator new(size, std::align_val_t(Alignment));
+	}
+
+	void AlignedAllocator::deallocate(u8* ptr, u64)
+	{
+		::operator delete(ptr, std::align_val_t(Alignment));
+	}
+
+	HugePageAllocator::~HugePageAllocator()
+	{
+		clear();
+	}
+
+	u64 HugePageAllocator::mappedSize(u64 size)
+	{
+		return (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+	}
+
+	u8* HugePageAllocator::allocate(u64 size)
+	{
+		if (size < mMinSize)
+			return mSmall.allocate(size);
+
+		auto mapped = mappedSize(size);
+		{
+			std::lock_guard<std::mutex> lock(mMtx);
+			auto iter = mCache.find(mapped);
+			if (iter != mCache.end() && iter->second.size())
+			{
+				auto ptr = iter->second.back();
+				iter->second.pop_back();
+				mCacheSize -= mapped;
+				return ptr;
+			}
+		}
+
+#ifdef _WIN32
+		return mSmall.allocate(size);
+#else
+		void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if (mUseHugeTlb)
+			ptr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (ptr == MAP_FAILED)
+		{
+			// no reserved huge pages, ask for transparent huge pages. mmap
+			// returns page aligned memory which is enough for Alignment
+			// but THP wants HugePageSize aligned regions. Over map and
+			// trim the ends to get that.
+			auto over = mapped + HugePageSize;
+			auto base = mmap(nullptr, over, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (base == MAP_FAILED)
+				throw std::bad_alloc();
+
+			auto begin = (u8*)base;
+			auto aligned = (u8*)(((u64)begin + HugePageSize - 1) / HugePageSize * HugePageSize);
+			auto end = begin + over;
+			if (aligned != begin)
+				munmap(begin, aligned - begin);
+			if (aligned + mapped != end)
+				munmap(aligned + mapped, end - (aligned + mapped));
+
+			ptr = aligned;
+#ifdef MADV_HUGEPAGE
+			madvise(ptr, mapped, MADV_HUGEPAGE);
+#endif
+		}
+		return (u8*)ptr;
+#endif
+	}
+
+	void HugePageAllocator::deallocate(u8* ptr, u64 size)
+	{
+		if (size < mMinSize)
+			return mSmall.deallocate(ptr, size);
+
+#ifdef _WIN32
+		mSmall.deallocate(ptr, size);
+#else
+		auto mapped = mappedSize(size);
+		auto fits = [&] { return mCacheSize + mapped <= mMaxCacheSize; };
+		{
+			std::unique_lock<std::mutex> lock(mMtx);
+			if (fits())
+			{
+				// the pages stay resident, do not keep what was in them.
+				lock.unlock();
+				std::memset(ptr, 0, size);
+				lock.lock();
+
+				if (fits())
+				{
+					mCache[mapped].push_back(ptr);
+					mCacheSize += mapped;
+					return;
+				}
+			}
+		}
+
+		munmap(ptr, mapped);
+#endif
+	}
+
+	void HugePageAllocator::clear()
+	{
+		std::lock_guard<std::mutex> lock(mMtx);
+		for (auto& c : mCache)
+		{
+			for (auto ptr : c.second)
+			{
+#ifdef _WIN32
+				mSmall.deallocate(ptr, c.first);
+#else
+				munmap(ptr, c.first);
+#endif
+			}
+		}
+		mCache.clear();
+		mCacheSize = 0;
+	}
+
+	u64 HugePageAllocator::cacheSize() const
+	{
+		std::lock_guard<std::mutex> lock(mMtx);
+		return mCacheSize;
+	}
+
+	PaxosAllocator*& paxosAllocator()
+	{
+		// never destroyed, buffers may outlive other statics.
+		static PaxosAllocator* alloc = new HugePageAllocator;
+		return alloc;
+	}
+}
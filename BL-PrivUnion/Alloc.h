@@ -0,0 +1,146 @@
+#pragma once
+#include "Defines.h"
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace volePSI
+{
+	// The allocator used for the large buffers of Paxos, Baxos and
+	// the OPRF, see paxosAllocator(). Memory is aligned to Alignment
+	// bytes and is not initialized.
+	class PaxosAllocator
+	{
+	public:
+		static constexpr u64 Alignment = 64;
+
+		virtual ~PaxosAllocator() = default;
+
+		// return size bytes of memory.
+		virtual u8* allocate(u64 size) = 0;
+
+		// free ptr, which was returned by allocate(size).
+		virtual void deallocate(u8* ptr, u64 size) = 0;
+	};
+
+	// Allocates using the aligned operator new.
+	class AlignedAllocator : public PaxosAllocator
+	{
+	public:
+		u8* allocate(u64 size) override;
+		void deallocate(u8* ptr, u64 size) override;
+	};
+
+	// Allocates buffers of at least mMinSize bytes from 2MB huge pages.
+	// If no huge pages are reserved (MAP_HUGETLB fails) the buffer is
+	// mapped with normal pages and transparent huge pages are requested
+	// with madvise. Freed buffers are zeroed and cached, they are handed
+	// out again to allocations of the same (page rounded) size so that
+	// repeated runs do not page fault again. The buffers may have held
+	// keys or VOLE correlations, hence the zeroing. Smaller buffers use
+	// AlignedAllocator.
+	class HugePageAllocator : public PaxosAllocator
+	{
+	public:
+		static constexpr u64 HugePageSize = 1ull << 21;
+
+		// buffers smaller than this are not mapped.
+		u64 mMinSize = 1ull << 20;
+
+		// the maximum number of bytes kept in the cache. The cached 
+		// buffers stay resident, a larger cache is an explicit choice.
+		u64 mMaxCacheSize = 1ull << 28;
+
+		// use MAP_HUGETLB before falling back to madvise.
+		bool mUseHugeTlb = true;
+
+		HugePageAllocator() = default;
+		HugePageAllocator(const HugePageAllocator&) = delete;
+		~HugePageAllocator();
+
+		u8* allocate(u64 size) override;
+		void deallocate(u8* ptr, u64 size) override;
+
+		// unmap all cached buffers.
+		void clear();
+
+		// the number of bytes currently cached.
+		u64 cacheSize() const;
+
+	private:
+		AlignedAllocator mSmall;
+		mutable std::mutex mMtx;
+		u64 mCacheSize = 0;
+
+		// the cached buffers by their mapped size.
+		std::map<u64, std::vector<u8*>> mCache;
+
+		// the mapped size of a buffer of size bytes.
+		static u64 mappedSize(u64 size);
+	};
+
+	// the allocator used by AllocBuffer. Defaults to a HugePageAllocator.
+	// Can be set to another allocator, which must outlive all buffers
+	// that it allocated.
+	PaxosAllocator*& paxosAllocator();
+
+	// An owning array of n T's from paxosAllocator(), used in place of
+	// std::unique_ptr<T[]>. The elements are not initialized, therefore
+	// T should be trivial.
+	template<typename T>
+	class AllocBuffer
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "AllocBuffer elements are not constructed.");
+	public:
+		AllocBuffer() = default;
+		AllocBuffer(const AllocBuffer&) = delete;
+		AllocBuffer(AllocBuffer&& o) noexcept { *this = std::move(o); }
+		explicit AllocBuffer(u64 n) { reset(n); }
+		~AllocBuffer() { reset(); }
+
+		AllocBuffer& operator=(const AllocBuffer&) = delete;
+		AllocBuffer& operator=(AllocBuffer&& o) noexcept
+		{
+			if (this != &o)
+			{
+				reset();
+				mPtr = std::exchange(o.mPtr, nullptr);
+				mSize = std::exchange(o.mSize, 0);
+				mAlloc = std::exchange(o.mAlloc, nullptr);
+			}
+			return *this;
+		}
+
+		// free the current buffer and allocate n elements.
+		void reset(u64 n = 0)
+		{
+			if (mPtr)
+				mAlloc->deallocate((u8*)mPtr, mSize * sizeof(T));
+			mPtr = nullptr;
+			mSize = 0;
+			mAlloc = nullptr;
+
+			if (n)
+			{
+				mAlloc = paxosAllocator();
+				mPtr = (T*)mAlloc->allocate(n * sizeof(T));
+				mSize = n;
+			}
+		}
+
+		T* get() const { return mPtr; }
+		T* data() const { return mPtr; }
+		u64 size() const { return mSize; }
+		T& operator[](u64 i) const { return mPtr[i]; }
+		operator span<T>() const { return span<T>(mPtr, mSize); }
+
+	private:
+		T* mPtr = nullptr;
+		u64 mSize = 0;
+
+		// the allocator that mPtr came from.
+		PaxosAllocator* mAlloc = nullptr;
+	};
+}
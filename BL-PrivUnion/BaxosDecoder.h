@@ -0,0 +1,205 @@
+#pragma once
+#include "Defines.h"
+#include "Paxos.h"
+#include <array>
+#include <vector>
+
+namespace volePSI
+{
+	// A read-only decoder for a Baxos encoding. The bin hasher, the bin
+	// divider, the paxos parameters of a bin and the hashers of bins that
+	// were solved with a retry are set up once by init(...). decode(...)
+	// is const and keeps its scratch on the stack, so any number of
+	// threads can share one decoder and decode small batches without a
+	// per call setup cost. Unlike Baxos::decode(...) the keys are not
+	// grouped by bin, which is faster for batches that are small compared
+	// to the number of bins.
+	class BaxosDecoder
+	{
+	public:
+		BaxosDecoder() = default;
+
+		// see init(...).
+		BaxosDecoder(const Baxos& baxos) { init(baxos); }
+
+		// set up the decoder for encodings made by baxos, including its
+		// mBinRetries and mAddToDecode.
+		void init(const Baxos& baxos);
+
+		// decode a single input given the paxos p.
+		template<typename ValueType>
+		ValueType decode(const block& input, span<const ValueType> p) const
+		{
+			ValueType r;
+			decode(span<const block>(&input, 1), span<ValueType>(&r, 1), p);
+			return r;
+		}
+
+		// decode the inputs and write the result to values. p is the paxos vector.
+		template<typename ValueType>
+		void decode(span<const block> inputs, span<ValueType> values, span<const ValueType> p) const
+		{
+			PxVector<ValueType> V(values);
+			PxVector<const ValueType> P(p);
+			auto h = V.defaultHelper();
+			decode(inputs, V, P, h);
+		}
+
+		// decode the inputs and write the result to values. p is the paxos matrix.
+		template<typename ValueType>
+		void decode(span<const block> inputs, MatrixView<ValueType> values, MatrixView<const ValueType> p) const
+		{
+			if (values.cols() != p.cols())
+				throw RTE_LOC;
+
+			PxMatrix<ValueType> V(values);
+			PxMatrix<const ValueType> P(p);
+			auto h = V.defaultHelper();
+			decode(inputs, V, P, h);
+		}
+
+		// decode the inputs and write the result to values.
+		template<typename Vec, typename ConstVec, typename Helper>
+		void decode(span<const block> inputs, Vec& values, ConstVec& p, Helper& h) const;
+
+		// add the decoded value to the output, as opposed to overwriting.
+		bool mAddToDecode = false;
+
+	private:
+		u64 mNumBins = 0, mSizePer = 0, mIdxBytes = 0;
+
+		// hashes the inputs, the hash selects the bin and the row.
+		AES mHasher;
+		libdivide::libdivide_u64_t mDivider{};
+
+		// a paxos with the parameters of a bin. Only the one for the
+		// index type of the encoding is initialized.
+		Paxos<u8> mPaxos8;
+		Paxos<u16> mPaxos16;
+		Paxos<u32> mPaxos32;
+		Paxos<u64> mPaxos64;
+
+		// mRetryHashers[mRetryIdx[binIdx] - 1] hashes the keys of a bin
+		// that was solved with a retry, 0 if it was not. Empty if no bin
+		// has a retry.
+		std::vector<u32> mRetryIdx;
+		std::vector<AES> mRetryHashers;
+
+		template<typename IdxType>
+		const Paxos<IdxType>& paxos() const
+		{
+			if constexpr (std::is_same<IdxType, u8>::value)
+				return mPaxos8;
+			else if constexpr (std::is_same<IdxType, u16>::value)
+				return mPaxos16;
+			else if constexpr (std::is_same<IdxType, u32>::value)
+				return mPaxos32;
+			else
+				return mPaxos64;
+		}
+
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		void implDecode(span<const block> inputs, Vec& values, ConstVec& p, Helper& h) const;
+	};
+
+	inline void BaxosDecoder::init(const Baxos& baxos)
+	{
+		if (baxos.mNumBins == 0)
+			throw RTE_LOC;
+
+		mNumBins = baxos.mNumBins;
+		mSizePer = baxos.mPaxosParam.size();
+		mAddToDecode = baxos.mAddToDecode;
+		mHasher.setKey(baxos.mSeed);
+		if (mNumBins > 1)
+			mDivider = libdivide::libdivide_u64_gen(mNumBins);
+
+		// a single bin baxos is a paxos of all the items. Its rows are
+		// derived from the same hash as those of a bin.
+		auto numItems = mNumBins == 1 ? baxos.mNumItems : baxos.mItemsPerBin;
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(baxos.mPaxosParam.mSparseSize + 1)), 8);
+		mIdxBytes = bitLength / 8;
+		if (bitLength <= 8)
+			mPaxos8.init(numItems, baxos.mPaxosParam, baxos.mSeed);
+		else if (bitLength <= 16)
+			mPaxos16.init(numItems, baxos.mPaxosParam, baxos.mSeed);
+		else if (bitLength <= 32)
+			mPaxos32.init(numItems, baxos.mPaxosParam, baxos.mSeed);
+		else
+			mPaxos64.init(numItems, baxos.mPaxosParam, baxos.mSeed);
+
+		mRetryIdx.clear();
+		mRetryHashers.clear();
+		for (u64 binIdx = 0; binIdx < baxos.mBinRetries.size(); ++binIdx)
+		{
+			if (auto retry = baxos.binRetries(binIdx))
+			{
+				mRetryIdx.resize(mNumBins);
+				mRetryHashers.emplace_back(baxos.binSeed(binIdx, retry));
+				mRetryIdx[binIdx] = static_cast<u32>(mRetryHashers.size());
+			}
+		}
+	}
+
+	template<typename Vec, typename ConstVec, typename Helper>
+	void BaxosDecoder::decode(span<const block> inputs, Vec& values, ConstVec& p, Helper& h) const
+	{
+		if (static_cast<u64>(values.size()) != inputs.size() ||
+			static_cast<u64>(p.size()) != mNumBins * mSizePer)
+			throw RTE_LOC;
+
+		if (mIdxBytes <= 1)
+			implDecode<u8>(inputs, values, p, h);
+		else if (mIdxBytes <= 2)
+			implDecode<u16>(inputs, values, p, h);
+		else if (mIdxBytes <= 4)
+			implDecode<u32>(inputs, values, p, h);
+		else
+			implDecode<u64>(inputs, values, p, h);
+	}
+
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	void BaxosDecoder::implDecode(span<const block> inputs, Vec& values, ConstVec& p, Helper& h) const
+	{
+		static constexpr const u64 batchSize = 32;
+
+		auto& paxos = this->paxos<IdxType>();
+		std::array<block, batchSize> hashes;
+		std::array<u64, batchSize> binIdxs{};
+
+		auto rehash = [&](u64 binIdx, block& hash)
+		{
+			if (mRetryIdx.size() && mRetryIdx[binIdx])
+				hash = mRetryHashers[mRetryIdx[binIdx] - 1].hashBlock(hash);
+		};
+
+		for (u64 i = 0; i < inputs.size(); i += batchSize)
+		{
+			auto n = std::min<u64>(batchSize, inputs.size() - i);
+			if (n == batchSize)
+			{
+				mHasher.hashBlocks<8>(inputs.data() + i + 0, hashes.data() + 0);
+				mHasher.hashBlocks<8>(inputs.data() + i + 8, hashes.data() + 8);
+				mHasher.hashBlocks<8>(inputs.data() + i + 16, hashes.data() + 16);
+				mHasher.hashBlocks<8>(inputs.data() + i + 24, hashes.data() + 24);
+			}
+			else
+				mHasher.hashBlocks(inputs.subspan(i, n), span<block>(hashes.data(), n));
+
+			if (mNumBins > 1)
+			{
+				for (u64 k = 0; k < n; ++k)
+					binIdxs[k] = Baxos::binIdxCompress(hashes[k]);
+
+				if (n == batchSize)
+					doMod32(binIdxs.data(), &mDivider, mNumBins);
+				else
+					for (u64 k = 0; k < n; ++k)
+						binIdxs[k] %= mNumBins;
+			}
+
+			Baxos::decodeBinHashes(paxos, span<block>(hashes.data(), n), binIdxs.data(),
+				mSizePer, mAddToDecode, values, i, p, h, rehash);
+		}
+	}
+}
@@ -0,0 +1,276 @@
+#include "BaxosFileEncoder.h"
+#include "PaxosFile.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+namespace volePSI
+{
+	BaxosFileEncoder::~BaxosFileEncoder()
+	{
+		removeParts();
+	}
+
+	void BaxosFileEncoder::init(
+		const Baxos& baxos,
+		u64 valueBlocks,
+		const std::string& outPath,
+		const std::string& tempDir,
+		u64 memoryBudget)
+	{
+		// the keys are partitioned by bin so that only some bins are held
+		// in memory at a time. A single bin is solved all at once and would
+		// need all keys in memory anyway.
+		if (baxos.mNumBins < 2)
+			throw std::runtime_error("BaxosFileEncoder needs more than one bin, use Baxos::solve(...) for small sets. " LOCATION);
+		if (valueBlocks == 0)
+			throw RTE_LOC;
+
+		removeParts();
+		mBaxos = baxos;
+		mValueBlocks = valueBlocks;
+		mNumKeys = 0;
+		mOutPath = outPath;
+		mTempDir = tempDir;
+
+		// the retries are filled in as the bins are solved.
+		mBaxos.mBinRetries.assign(mBaxos.mMaxBinRetries ? mBaxos.mNumBins : 0, 0);
+
+		auto numBins = mBaxos.mNumBins;
+		auto recordBlocks = 1 + mValueBlocks;
+		auto sizePer = mBaxos.mPaxosParam.size();
+
+		// the memory needed to hold and solve a full bin.
+		auto perBin = (mBaxos.mItemsPerBin * recordBlocks + sizePer * mValueBlocks) * sizeof(block);
+		mBinsPerPart = std::min<u64>(numBins, std::max<u64>(1, memoryBudget / 2 / perBin));
+		mNumParts = (numBins + mBinsPerPart - 1) / mBinsPerPart;
+
+		// at least 1024 records per write.
+		auto bufferRecords = std::max<u64>(1024, memoryBudget / 2 / mNumParts / (recordBlocks * sizeof(block)));
+		mBufferBlocks = bufferRecords * recordBlocks;
+
+		mBinSizes.assign(numBins, 0);
+		mBuffers.clear();
+		mBuffers.resize(mNumParts);
+
+		// start with empty partition files.
+		for (u64 k = 0; k < mNumParts; ++k)
+		{
+			std::ofstream out(partPath(k), std::ios::binary | std::ios::trunc);
+			if (!out)
+				throw std::runtime_error("failed to create " + partPath(k) + ". " LOCATION);
+		}
+	}
+
+	void BaxosFileEncoder::add(span<const block> keys, MatrixView<const block> values)
+	{
+		if (mBinSizes.empty())
+			throw std::runtime_error("BaxosFileEncoder::init(...) must be called first. " LOCATION);
+		if (keys.size() != values.rows() || values.cols() != mValueBlocks)
+			throw RTE_LOC;
+
+		static constexpr const u64 batchSize = 32;
+		std::array<block, batchSize> hashes;
+		AES hasher(mBaxos.mSeed);
+
+		for (u64 i = 0; i < keys.size(); i += batchSize)
+		{
+			auto m = std::min<u64>(batchSize, keys.size() - i);
+			hasher.hashBlocks(keys.subspan(i, m), span<block>(hashes.data(), m));
+
+			for (u64 j = 0; j < m; ++j)
+			{
+				auto binIdx = mBaxos.modNumBins(hashes[j]);
+				if (++mBinSizes[binIdx] > mBaxos.mItemsPerBin)
+					throw std::runtime_error("a bin has more keys than the baxos was initialized for. " LOCATION);
+
+				auto k = binIdx / mBinsPerPart;
+				auto& buffer = mBuffers[k];
+				if (buffer.capacity() == 0)
+					buffer.reserve(mBufferBlocks);
+
+				auto v = values[i + j];
+				buffer.push_back(hashes[j]);
+				buffer.insert(buffer.end(), v.begin(), v.end());
+
+				if (buffer.size() >= mBufferBlocks)
+					flush(k);
+			}
+		}
+
+		mNumKeys += keys.size();
+	}
+
+	void BaxosFileEncoder::finish(oc::PRNG* prng, u64 numThreads)
+	{
+		if (mBinSizes.empty())
+			throw std::runtime_error("BaxosFileEncoder::init(...) must be called first. " LOCATION);
+
+		numThreads = std::max<u64>(1, numThreads);
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mBaxos.mPaxosParam.mSparseSize + 1)), 8);
+		if (bitLength <= 8)
+			implFinish<u8>(prng, numThreads);
+		else if (bitLength <= 16)
+			implFinish<u16>(prng, numThreads);
+		else if (bitLength <= 32)
+			implFinish<u32>(prng, numThreads);
+		else
+			implFinish<u64>(prng, numThreads);
+
+		removeParts();
+		mBinSizes.clear();
+		mBuffers.clear();
+	}
+
+	template<typename IdxType>
+	void BaxosFileEncoder::implFinish(oc::PRNG* prng, u64 numThreads)
+	{
+		std::ofstream out(mOutPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+			throw std::runtime_error("failed to open " + mOutPath + " for writing. " LOCATION);
+
+		// mBaxos.mNumItems is the capacity, the file records the keys that were added.
+		auto header = paxosFileHeader(mBaxos, mValueBlocks * sizeof(block));
+		header.mNumItems = mNumKeys;
+		details::writePaxosFileHeader(out, header);
+
+		auto numBins = mBaxos.mNumBins;
+		auto recordBlocks = 1 + mValueBlocks;
+		auto sizePer = mBaxos.mPaxosParam.size();
+
+		// the buffers are sized for the partition with the most keys.
+		u64 maxPartKeys = 0;
+		for (u64 k = 0; k < mNumParts; ++k)
+		{
+			auto e = std::min<u64>(numBins, (k + 1) * mBinsPerPart);
+			u64 n = 0;
+			for (u64 b = k * mBinsPerPart; b < e; ++b)
+				n += mBinSizes[b];
+			maxPartKeys = std::max(maxPartKeys, n);
+		}
+
+		AllocBuffer<block> hashes(maxPartKeys);
+		AllocBuffer<block> values(maxPartKeys * mValueBlocks);
+		AllocBuffer<block> p(mBinsPerPart * sizePer * mValueBlocks);
+		std::vector<block> chunk(mBufferBlocks);
+		std::vector<u64> offsets(mBinsPerPart + 1), cursor(mBinsPerPart);
+
+		for (u64 k = 0; k < mNumParts; ++k)
+		{
+			auto binBegin = k * mBinsPerPart;
+			auto binEnd = std::min<u64>(numBins, binBegin + mBinsPerPart);
+			auto partBins = binEnd - binBegin;
+
+			flush(k);
+			std::vector<block>().swap(mBuffers[k]);
+
+			// offsets[b] is where the keys of bin binBegin + b begin.
+			for (u64 b = 0; b < partBins; ++b)
+				offsets[b + 1] = offsets[b] + mBinSizes[binBegin + b];
+			std::copy(offsets.begin(), offsets.begin() + partBins, cursor.begin());
+
+			// load the records of the partition grouped by bin.
+			{
+				auto path = partPath(k);
+				std::ifstream in(path, std::ios::binary);
+				if (!in)
+					throw std::runtime_error("failed to open " + path + ". " LOCATION);
+
+				auto remaining = offsets[partBins] * recordBlocks;
+				while (remaining)
+				{
+					auto m = std::min<u64>(remaining, chunk.size());
+					in.read((char*)chunk.data(), m * sizeof(block));
+					if (!in)
+						throw std::runtime_error("failed to read " + path + ". " LOCATION);
+
+					for (u64 r = 0; r < m; r += recordBlocks)
+					{
+						auto j = cursor[mBaxos.modNumBins(chunk[r]) - binBegin]++;
+						hashes[j] = chunk[r];
+						std::copy(chunk.data() + r + 1, chunk.data() + r + recordBlocks, values.data() + j * mValueBlocks);
+					}
+					remaining -= m;
+				}
+			}
+			std::remove(partPath(k).c_str());
+
+			// each thread takes the next unsolved bin until all are done.
+			std::atomic<u64> nextBin(binBegin);
+			threadPool()->run(numThreads, [&](u64)
+			{
+				Paxos<IdxType> paxos;
+				AllocBuffer<u8> allocation(mBaxos.binSolveAllocSize<IdxType>());
+
+				// with fewer bins than threads, each bin is solved with several.
+				paxos.mNumThreads = std::max<u64>(1, numThreads / partBins);
+
+				for (u64 binIdx = nextBin++; binIdx < binEnd; binIdx = nextBin++)
+				{
+					auto b = binIdx - binBegin;
+					auto begin = offsets[b];
+					auto size = offsets[b + 1] - begin;
+					span<block> binHashes(hashes.data() + begin, size);
+					auto binP = p.data() + b * sizePer * mValueBlocks;
+					u64 retry;
+
+					if (mValueBlocks == 1)
+					{
+						PxVector<const block> V(span<const block>(values.data() + begin, size));
+						PxVector<block> P(span<block>(binP, sizePer));
+						auto h = P.defaultHelper();
+						retry = mBaxos.implSolveBin(binIdx, binHashes, V, P, prng, h, paxos, allocation.data());
+					}
+					else
+					{
+						PxMatrix<const block> V(MatrixView<const block>(values.data() + begin * mValueBlocks, size, mValueBlocks));
+						PxMatrix<block> P(MatrixView<block>(binP, sizePer, mValueBlocks));
+						auto h = P.defaultHelper();
+						retry = mBaxos.implSolveBin(binIdx, binHashes, V, P, prng, h, paxos, allocation.data());
+					}
+
+					if (mBaxos.mBinRetries.size())
+						mBaxos.mBinRetries[binIdx] = static_cast<u8>(retry);
+				}
+			});
+
+			out.write((const char*)p.data(), partBins * sizePer * mValueBlocks * sizeof(block));
+			if (!out)
+				throw std::runtime_error("failed to write " + mOutPath + ". " LOCATION);
+		}
+
+		if (header.mHasBinRetries)
+			out.write((const char*)mBaxos.mBinRetries.data(), numBins);
+
+		out.flush();
+		if (!out)
+			throw std::runtime_error("failed to write " + mOutPath + ". " LOCATION);
+	}
+
+	std::string BaxosFileEncoder::partPath(u64 k) const
+	{
+		return mTempDir + "/baxos_part_" + std::to_string(k) + ".bin";
+	}
+
+	void BaxosFileEncoder::flush(u64 k)
+	{
+		auto& buffer = mBuffers[k];
+		if (buffer.empty())
+			return;
+
+		// opened per write so that the number of partitions is not
+		// limited by the number of open files.
+		std::ofstream out(partPath(k), std::ios::binary | std::ios::app);
+		out.write((const char*)buffer.data(), buffer.size() * sizeof(block));
+		if (!out)
+			throw std::runtime_error("failed to write " + partPath(k) + ". " LOCATION);
+		buffer.clear();
+	}
+
+	void BaxosFileEncoder::removeParts()
+	{
+		for (u64 k = 0; k < mNumParts; ++k)
+			std::remove(partPath(k).c_str());
+		mNumParts = 0;
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "Defines.h"
+#include "Paxos.h"
+#include <string>
+#include <vector>
+
+namespace volePSI
+{
+	// Encodes a Baxos whose keys and values do not fit in memory and
+	// writes p to a paxos file, see PaxosFile.h. Keys are hashed as they
+	// are added and their (hash, value) records are appended to partition
+	// files in a temporary directory, each partition holding a contiguous
+	// range of bins. finish() then loads one partition at a time, solves
+	// its bins and appends their part of p to the output file. About
+	// memoryBudget bytes are held in memory, half for the buffers of the
+	// partition files and half for the partition being solved. The values
+	// are rows of valueBlocks blocks. The file is decoded with 
+	// MappedPaxosFile like one written by writePaxosFile(...). With
+	// Baxos::mMaxBinRetries set, a bin that fails is re-solved alone.
+	class BaxosFileEncoder
+	{
+	public:
+		BaxosFileEncoder() = default;
+		BaxosFileEncoder(const BaxosFileEncoder&) = delete;
+
+		// removes the partition files that are left.
+		~BaxosFileEncoder();
+
+		// begin an encoding with the parameters of baxos, which must have
+		// more than one bin and be initialized for at least the number of
+		// keys that will be added. The partition files are created in 
+		// tempDir, which should not be used by another encoder at the 
+		// same time.
+		void init(
+			const Baxos& baxos,
+			u64 valueBlocks,
+			const std::string& outPath,
+			const std::string& tempDir,
+			u64 memoryBudget = 1ull << 30);
+
+		// add the next chunk of keys. The i'th row of values is the value of keys[i].
+		void add(span<const block> keys, MatrixView<const block> values);
+
+		// add the next chunk of keys. valueBlocks must be 1.
+		void add(span<const block> keys, span<const block> values)
+		{
+			add(keys, MatrixView<const block>(values.data(), values.size(), 1));
+		}
+
+		// solve the bins and write the paxos file. prng should be non-null
+		// if randomized paxos is desired. The encoder can not be used
+		// again until init(...) is called.
+		void finish(oc::PRNG* prng = nullptr, u64 numThreads = 0);
+
+		// the number of keys added so far.
+		u64 size() const { return mNumKeys; }
+
+	private:
+		Baxos mBaxos;
+		u64 mValueBlocks = 0, mNumKeys = 0;
+		std::string mOutPath, mTempDir;
+
+		// partition k holds the bins [k * mBinsPerPart, (k+1) * mBinsPerPart).
+		u64 mBinsPerPart = 0, mNumParts = 0;
+
+		// the number of keys of each bin.
+		std::vector<u64> mBinSizes;
+
+		// the records of each partition that have not been written yet.
+		// A record is the hash of a key followed by its value.
+		std::vector<std::vector<block>> mBuffers;
+
+		// the number of blocks a buffer holds before it is written.
+		u64 mBufferBlocks = 0;
+
+		std::string partPath(u64 k) const;
+
+		// append the buffer of partition k to its file.
+		void flush(u64 k);
+
+		// delete the partition files.
+		void removeParts();
+
+		template<typename IdxType>
+		void implFinish(oc::PRNG* prng, u64 numThreads);
+	};
+}
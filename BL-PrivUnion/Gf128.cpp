@@ -0,0 +1,126 @@
+#include "Gf128.h"
+
+namespace volePSI
+{
+	void Gf128Key::setKey(const block& d)
+	{
+		mD = d;
+		mDK = block(0, d.get<u64>(0) ^ d.get<u64>(1));
+	}
+
+	namespace
+	{
+		// out[i] (^)= d * in[i] using block::gf128Mul.
+		template<bool add>
+		void mulScalar(const block* in, const block& d, block* out, u64 n)
+		{
+			for (u64 i = 0; i < n; ++i)
+			{
+				if (add)
+					out[i] = out[i] ^ d.gf128Mul(in[i]);
+				else
+					out[i] = d.gf128Mul(in[i]);
+			}
+		}
+
+#if defined(ENABLE_SSE) && (defined(__GNUC__) || defined(__clang__))
+#define GF128_SIMD
+#define GF128_TARGET_AVX512 __attribute__((target("avx2,pclmul,avx512f,avx512bw,vpclmulqdq")))
+
+		enum class Isa
+		{
+			Scalar,
+			Avx512
+		};
+
+		Isa detectIsa()
+		{
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f") &&
+				__builtin_cpu_supports("avx512bw") &&
+				__builtin_cpu_supports("vpclmulqdq"))
+				return Isa::Avx512;
+			return Isa::Scalar;
+		}
+
+		Isa getIsa()
+		{
+			static Isa isa = detectIsa();
+			return isa;
+		}
+
+		// out[i] (^)= d * in[i], eight blocks at a time in two zmm registers.
+		// Each VPCLMULQDQ multiplies four blocks, Karatsuba with the precomputed 
+		// d.hi ^ d.lo takes three of them, and the reduction is shared by the 
+		// four blocks of a register.
+		template<bool add>
+		GF128_TARGET_AVX512 void mulAvx512(const block* in, const Gf128Key& key, block* out, u64 n)
+		{
+			const __m512i d = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)&key.mD));
+			const __m512i dk = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)&key.mDK));
+			const __m512i modulus = _mm512_broadcast_i32x4(_mm_set_epi64x(0, 0b10000111));
+
+			auto main = n / 8 * 8;
+			for (u64 i = 0; i < main; i += 8)
+			{
+				__m512i x[2], lo[2], hi[2], mid[2];
+				for (u64 j = 0; j < 2; ++j)
+				{
+					x[j] = _mm512_loadu_si512((const void*)(in + i + 4 * j));
+					lo[j] = _mm512_clmulepi64_epi128(x[j], d, 0x00);
+					hi[j] = _mm512_clmulepi64_epi128(x[j], d, 0x11);
+					mid[j] = _mm512_clmulepi64_epi128(
+						_mm512_xor_si512(x[j], _mm512_bsrli_epi128(x[j], 8)), dk, 0x00);
+					mid[j] = _mm512_ternarylogic_epi64(mid[j], lo[j], hi[j], 0x96);
+					lo[j] = _mm512_xor_si512(lo[j], _mm512_bslli_epi128(mid[j], 8));
+					hi[j] = _mm512_xor_si512(hi[j], _mm512_bsrli_epi128(mid[j], 8));
+				}
+
+				for (u64 j = 0; j < 2; ++j)
+				{
+					__m512i tmp = _mm512_clmulepi64_epi128(hi[j], modulus, 0x01);
+					lo[j] = _mm512_xor_si512(lo[j], _mm512_bslli_epi128(tmp, 8));
+					hi[j] = _mm512_xor_si512(hi[j], _mm512_bsrli_epi128(tmp, 8));
+					tmp = _mm512_clmulepi64_epi128(hi[j], modulus, 0x00);
+
+					__m512i r;
+					if (add)
+						r = _mm512_ternarylogic_epi64(lo[j], tmp,
+							_mm512_loadu_si512((const void*)(out + i + 4 * j)), 0x96);
+					else
+						r = _mm512_xor_si512(lo[j], tmp);
+					_mm512_storeu_si512((void*)(out + i + 4 * j), r);
+				}
+			}
+
+			mulScalar<add>(in + main, key.mD, out + main, n - main);
+		}
+#endif
+
+		template<bool add>
+		void mul(span<const block> in, const Gf128Key& d, span<block> out)
+		{
+			if (in.size() != out.size())
+				throw RTE_LOC;
+
+#ifdef GF128_SIMD
+			if (getIsa() == Isa::Avx512)
+			{
+				mulAvx512<add>(in.data(), d, out.data(), in.size());
+				return;
+			}
+#endif
+			mulScalar<add>(in.data(), d.mD, out.data(), in.size());
+		}
+	}
+
+	void gf128MulConst(span<const block> in, const Gf128Key& d, span<block> out)
+	{
+		mul<false>(in, d, out);
+	}
+
+	void gf128MulConstAdd(span<const block> in, const Gf128Key& d, span<block> out)
+	{
+		mul<true>(in, d, out);
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "Defines.h"
+
+namespace volePSI
+{
+	// A gf128 multiplier d that is fixed for many batched multiplications,
+	// e.g. the OPRF sender's VOLE delta. Holds the values that the
+	// kernels would otherwise recompute on every call.
+	struct Gf128Key
+	{
+		// the multiplier.
+		block mD;
+
+		// d.hi ^ d.lo in the low half, the karatsuba middle term.
+		block mDK;
+
+		Gf128Key() = default;
+		Gf128Key(const block& d) { setKey(d); }
+
+		void setKey(const block& d);
+	};
+
+	// out[i] = d * in[i] in gf128 for all i. out may alias in.
+	void gf128MulConst(span<const block> in, const Gf128Key& d, span<block> out);
+
+	// out[i] = d * in[i] in gf128 for all i. out may alias in.
+	inline void gf128MulConst(span<const block> in, const block& d, span<block> out)
+	{
+		gf128MulConst(in, Gf128Key(d), out);
+	}
+
+	// out[i] = out[i] ^ d * in[i] in gf128 for all i.
+	void gf128MulConstAdd(span<const block> in, const Gf128Key& d, span<block> out);
+
+	// out[i] = out[i] ^ d * in[i] in gf128 for all i.
+	inline void gf128MulConstAdd(span<const block> in, const block& d, span<block> out)
+	{
+		gf128MulConstAdd(in, Gf128Key(d), out);
+	}
+}
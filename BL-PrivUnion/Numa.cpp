@@ -0,0 +1,135 @@
+#include "Numa.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace volePSI
+{
+	namespace
+	{
+		// parse a sysfs cpu list such as "0-3,8-11".
+		std::vector<u32> parseCpuList(const std::string& str)
+		{
+			std::vector<u32> cpus;
+			std::stringstream ss(str);
+			std::string range;
+			while (std::getline(ss, range, ','))
+			{
+				if (range.empty() || range == "\n")
+					continue;
+
+				auto dash = range.find('-');
+				u32 b = std::stoul(range.substr(0, dash));
+				u32 e = dash == std::string::npos ? b : std::stoul(range.substr(dash + 1));
+				for (auto c = b; c <= e; ++c)
+					cpus.push_back(c);
+			}
+			return cpus;
+		}
+
+		NumaTopology detectTopology()
+		{
+			NumaTopology t;
+#ifdef __linux__
+			for (u64 node = 0;; ++node)
+			{
+				std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+				if (!in)
+					break;
+
+				std::string line;
+				std::getline(in, line);
+				auto cpus = parseCpuList(line);
+
+				// memory only nodes have no cpus to pin to.
+				if (cpus.size())
+				{
+					t.mNodeIds.push_back(static_cast<u32>(node));
+					t.mNodeCpus.push_back(std::move(cpus));
+				}
+			}
+#endif
+			if (t.mNodeCpus.empty())
+			{
+				t.mNodeIds.push_back(0);
+				t.mNodeCpus.emplace_back();
+				for (u32 i = 0; i < std::thread::hardware_concurrency(); ++i)
+					t.mNodeCpus.back().push_back(i);
+			}
+			return t;
+		}
+	}
+
+	const NumaTopology& numaTopology()
+	{
+		static const NumaTopology t = detectTopology();
+		return t;
+	}
+
+	NumaPin::NumaPin(u64 node)
+	{
+#ifdef __linux__
+		auto& topo = numaTopology();
+		if (topo.numNodes() < 2)
+			return;
+
+		static_assert(sizeof(cpu_set_t) <= sizeof(mSaved), "cpu_set_t is too large");
+		auto saved = (cpu_set_t*)mSaved.data();
+		if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), saved))
+			return;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (auto c : topo.mNodeCpus[node % topo.numNodes()])
+			if (c < CPU_SETSIZE)
+				CPU_SET(c, &set);
+
+		mPinned = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#endif
+	}
+
+	NumaPin::~NumaPin()
+	{
+#ifdef __linux__
+		if (mPinned)
+			pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), (cpu_set_t*)mSaved.data());
+#endif
+	}
+
+	void numaBind(const void* begin, const void* end, u64 node)
+	{
+#if defined(__linux__) && defined(SYS_mbind)
+		auto& topo = numaTopology();
+		if (topo.numNodes() < 2)
+			return;
+
+		// from <numaif.h>, which needs libnuma.
+		constexpr int MpolPreferred = 1;
+		constexpr unsigned MpolMfMove = 1 << 1;
+
+		u64 page = sysconf(_SC_PAGESIZE);
+		auto b = ((u64)begin + page - 1) / page * page;
+		auto e = (u64)end / page * page;
+		if (b >= e)
+			return;
+
+		constexpr u64 bits = sizeof(unsigned long) * 8;
+		std::array<unsigned long, 1024 / bits> mask{};
+		u64 id = topo.mNodeIds[node % topo.numNodes()];
+		if (id >= mask.size() * bits)
+			return;
+		mask[id / bits] |= 1ul << (id % bits);
+
+		// failures only cost performance.
+		syscall(SYS_mbind, b, e - b, MpolPreferred, mask.data(), mask.size() * bits, MpolMfMove);
+#endif
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "Defines.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace volePSI
+{
+	// The numa nodes of this machine and the cpus of each node. Read
+	// from /sys/devices/system/node. Machines without numa information
+	// have a single node with all cpus.
+	struct NumaTopology
+	{
+		// the os id and the cpus of each node that has cpus.
+		std::vector<u32> mNodeIds;
+		std::vector<std::vector<u32>> mNodeCpus;
+
+		u64 numNodes() const { return mNodeCpus.size(); }
+	};
+
+	// the topology of this machine, detected once.
+	const NumaTopology& numaTopology();
+
+	// Pins the calling thread to the cpus of a numa node and restores
+	// the previous affinity when destroyed. Pool threads are reused, so
+	// they should not be left pinned.
+	class NumaPin
+	{
+	public:
+		NumaPin(u64 node);
+		NumaPin(const NumaPin&) = delete;
+		~NumaPin();
+
+	private:
+		bool mPinned = false;
+
+		// the previous cpu_set_t of the thread.
+		std::array<u64, 16> mSaved;
+	};
+
+	// ask the os to place the pages of [begin, end) on the node'th node
+	// of numaTopology(). Pages that are already touched are moved. Only
+	// whole pages inside the range are bound. Does nothing if numa is not
+	// supported.
+	void numaBind(const void* begin, const void* end, u64 node);
+
+	// The assignment of bins and threads to numa nodes. Node k owns the
+	// bins [mBinBegin[k], mBinBegin[k+1]) and thread i runs on node
+	// i % numNodes(). Every node has at least one thread.
+	struct NumaBinSplit
+	{
+		std::vector<u64> mBinBegin;
+		u64 mNumThreads = 0;
+
+		NumaBinSplit() = default;
+
+		// split the bins between the nodes, or use a single node if numa is false.
+		NumaBinSplit(u64 numBins, u64 numThreads, bool numa = true)
+		{
+			auto numNodes = numa ? std::max<u64>(1, std::min<u64>(numaTopology().numNodes(), numThreads)) : 1;
+			mNumThreads = numThreads;
+			mBinBegin.resize(numNodes + 1);
+			for (u64 k = 0; k <= numNodes; ++k)
+				mBinBegin[k] = numBins * k / numNodes;
+		}
+
+		u64 numNodes() const { return mBinBegin.size() - 1; }
+
+		// the node of thread thrdIdx.
+		u64 nodeOf(u64 thrdIdx) const { return thrdIdx % numNodes(); }
+
+		// the index of thread thrdIdx among the threads of its node.
+		u64 localIdx(u64 thrdIdx) const { return thrdIdx / numNodes(); }
+
+		// the number of threads that run on node.
+		u64 numNodeThreads(u64 node) const { return (mNumThreads - node + numNodes() - 1) / numNodes(); }
+	};
+
+	// Hands out the bins of a NumaBinSplit to the threads. A thread takes
+	// the bins of its own node first and then helps the other nodes.
+	struct NumaBinQueue
+	{
+		NumaBinSplit mSplit;
+		std::unique_ptr<std::atomic<u64>[]> mNext;
+
+		NumaBinQueue(const NumaBinSplit& split)
+			: mSplit(split)
+			, mNext(new std::atomic<u64>[split.numNodes()])
+		{
+			for (u64 k = 0; k < split.numNodes(); ++k)
+				mNext[k] = split.mBinBegin[k];
+		}
+
+		// the next bin for thread thrdIdx. Returns the number of bins once
+		// all bins have been taken.
+		u64 next(u64 thrdIdx)
+		{
+			auto numNodes = mSplit.numNodes();
+			auto node = mSplit.nodeOf(thrdIdx);
+			for (u64 i = 0; i < numNodes; ++i)
+			{
+				auto k = (node + i) % numNodes;
+				auto binIdx = mNext[k].fetch_add(1, std::memory_order_relaxed);
+				if (binIdx < mSplit.mBinBegin[k + 1])
+					return binIdx;
+			}
+			return mSplit.mBinBegin.back();
+		}
+	};
+}
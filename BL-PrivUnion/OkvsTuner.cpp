@@ -0,0 +1,156 @@
+#include "OkvsTuner.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace volePSI
+{
+	OkvsConfig OkvsTuner::benchmark(u64 n, u64 numThreads, PaxosParam::DenseType dt, u64 weight, u64 binSize)
+	{
+		OkvsConfig config;
+		config.mWeight = weight;
+		config.mBinSize = binSize;
+
+		Baxos baxos;
+		baxos.init(n, binSize, weight, mSsp, dt, oc::ZeroBlock);
+		config.mExpansion = double(baxos.size()) / n;
+		config.mIdxBytes = oc::roundUpTo(oc::log2ceil(baxos.mPaxosParam.mSparseSize + 1), 8) / 8;
+		if (config.mExpansion > mMaxExpansion)
+			return config;
+
+		auto m = std::min<u64>(n, mMaxBenchItems);
+		baxos.init(m, binSize, weight, mSsp, dt, oc::ZeroBlock);
+
+		PRNG prng(oc::block(weight, binSize));
+		std::vector<block> keys(m), values(m), p(baxos.size());
+		prng.get<block>(keys);
+		prng.get<block>(values);
+
+		double best = std::numeric_limits<double>::max();
+		for (u64 i = 0; i < std::max<u64>(1, mTrials); ++i)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			baxos.solve<block>(keys, values, p, nullptr, numThreads);
+			baxos.decode<block>(keys, values, p, numThreads);
+			auto end = std::chrono::steady_clock::now();
+
+			best = std::min<double>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+		}
+		config.mNsPerItem = best / m;
+
+		return config;
+	}
+
+	OkvsConfig OkvsTuner::tune(u64 n, u64 numThreads, PaxosParam::DenseType dt)
+	{
+		if (n == 0)
+			throw RTE_LOC;
+		numThreads = std::max<u64>(1, numThreads);
+
+		OkvsConfig best;
+		if (loadProfile(n, numThreads, dt, best))
+			return best;
+
+		bool found = false;
+		for (auto w : mWeights)
+		{
+			// bin sizes of at least n all give the same single bin.
+			bool singleBin = false;
+			for (auto logBinSize : mLogBinSizes)
+			{
+				auto binSize = 1ull << logBinSize;
+				if (singleBin)
+					break;
+				singleBin = binSize >= n;
+
+				// a candidate can fail to solve, e.g. a small bin may not 
+				// peel. It is skipped rather than ending the search.
+				OkvsConfig config;
+				try
+				{
+					config = benchmark(n, numThreads, dt, w, binSize);
+				}
+				catch (std::exception& e)
+				{
+					if (mVerbose)
+						std::cout << "w=" << w << " binSize=" << binSize << " failed: " << e.what() << std::endl;
+					continue;
+				}
+
+				if (config.mExpansion > mMaxExpansion)
+				{
+					if (mVerbose)
+						std::cout << "w=" << w << " binSize=" << binSize << " expansion "
+						<< config.mExpansion << " too large" << std::endl;
+					continue;
+				}
+
+				if (mVerbose)
+					std::cout << "w=" << w << " binSize=" << binSize << " idx=" << config.mIdxBytes
+					<< " expansion " << config.mExpansion << " " << config.mNsPerItem << "ns/item" << std::endl;
+
+				if (!found || config.mNsPerItem < best.mNsPerItem)
+				{
+					best = config;
+					found = true;
+				}
+			}
+		}
+
+		if (!found)
+			throw std::runtime_error("no okvs configuration meets the expansion limit " + std::to_string(mMaxExpansion) + ". " LOCATION);
+
+		saveProfile(n, numThreads, dt, best);
+		return best;
+	}
+
+	// Each line of the profile is
+	//
+	//   n numThreads dt ssp maxExpansion weight binSize idxBytes expansion nsPerItem
+	//
+	// where the first five values are the key.
+	bool OkvsTuner::loadProfile(u64 n, u64 numThreads, PaxosParam::DenseType dt, OkvsConfig& config) const
+	{
+		if (mProfilePath.empty())
+			return false;
+
+		std::ifstream in(mProfilePath);
+		std::string line;
+		while (std::getline(in, line))
+		{
+			std::istringstream ss(line);
+			u64 n2, nt2, dt2, ssp2;
+			double maxExp2;
+			OkvsConfig c;
+			if (!(ss >> n2 >> nt2 >> dt2 >> ssp2 >> maxExp2 >>
+				c.mWeight >> c.mBinSize >> c.mIdxBytes >> c.mExpansion >> c.mNsPerItem))
+				continue;
+
+			if (n2 == n && nt2 == numThreads && dt2 == u64(dt) &&
+				ssp2 == mSsp && maxExp2 == mMaxExpansion)
+			{
+				config = c;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void OkvsTuner::saveProfile(u64 n, u64 numThreads, PaxosParam::DenseType dt, const OkvsConfig& c) const
+	{
+		if (mProfilePath.empty())
+			return;
+
+		std::ofstream out(mProfilePath, std::ios::app);
+		out.precision(17);
+		out << n << " " << numThreads << " " << u64(dt) << " " << mSsp << " " << mMaxExpansion << " "
+			<< c.mWeight << " " << c.mBinSize << " " << c.mIdxBytes << " "
+			<< c.mExpansion << " " << c.mNsPerItem << "\n";
+
+		if (!out && mVerbose)
+			std::cout << "failed to write the okvs profile " << mProfilePath << std::endl;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "Defines.h"
+#include "Paxos.h"
+#include <string>
+#include <vector>
+
+namespace volePSI
+{
+	// The Baxos parameters selected by OkvsTuner.
+	struct OkvsConfig
+	{
+		u64 mWeight = 3;
+		u64 mBinSize = 1 << 14;
+
+		// sizeof(IdxType) that Baxos uses for this bin size.
+		u64 mIdxBytes = 2;
+
+		// Baxos::size() / n.
+		double mExpansion = 0;
+
+		// the measured encode + decode time per item in nanoseconds.
+		double mNsPerItem = 0;
+	};
+
+	// Selects the weight and bin size of a Baxos for a given number of
+	// items, threads and dense type by benchmarking the candidates on this
+	// machine. The candidate with the fastest encode + decode time whose
+	// expansion is at most mMaxExpansion is returned. The index type is
+	// not a free parameter, Baxos uses the smallest one that fits the bin,
+	// so it is reported along with the bin size. Results are cached in the
+	// profile file so that later runs do not benchmark again.
+	class OkvsTuner
+	{
+	public:
+		// the candidate weights and log2 bin sizes, in increasing order.
+		std::vector<u64> mWeights{ 3, 4, 5 };
+		std::vector<u64> mLogBinSizes{ 10, 11, 12, 13, 14, 15, 16, 17, 18 };
+
+		// the maximum allowed Baxos::size() / n.
+		double mMaxExpansion = 1.5;
+
+		u64 mSsp = 40;
+
+		// the number of times each candidate is run, the fastest counts.
+		u64 mTrials = 2;
+
+		// each candidate is benchmarked with at most this many items. The
+		// per item time of a bin size hardly depends on the total once
+		// there are enough bins for all threads.
+		u64 mMaxBenchItems = 1 << 20;
+
+		// the file the results are cached in. Empty disables the cache.
+		std::string mProfilePath = "okvs_profile.txt";
+
+		bool mVerbose = false;
+
+		// return the fastest configuration for n items. Candidates whose
+		// benchmark throws are skipped.
+		OkvsConfig tune(u64 n, u64 numThreads, PaxosParam::DenseType dt);
+
+		// benchmark a single configuration. The expansion is for n items.
+		OkvsConfig benchmark(u64 n, u64 numThreads, PaxosParam::DenseType dt, u64 weight, u64 binSize);
+
+	private:
+		bool loadProfile(u64 n, u64 numThreads, PaxosParam::DenseType dt, OkvsConfig& config) const;
+		void saveProfile(u64 n, u64 numThreads, PaxosParam::DenseType dt, const OkvsConfig& config) const;
+	};
+}
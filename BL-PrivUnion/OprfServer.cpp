@@ -0,0 +1,140 @@
+#include "OprfServer.h"
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace volePSI
+{
+	namespace
+	{
+		// the blocks per vole correlation that the silent vole sender holds
+		// at its peak, b included, while it expands the correlations.
+		constexpr u64 gVoleBlocksPerRow = 3;
+	}
+
+	u64 OprfServer::sessionMemory(u64 recverSize, u64 numKeys) const
+	{
+		Baxos paxos;
+		paxos.init(recverSize, mBinSize, mWeight, mSsp, PaxosParam::GF128, oc::ZeroBlock);
+
+		// the vole, at most two receive buffers of the size of the paxos
+		// and the eval(...) hashes. The parts of a split vole are copied
+		// into one b.
+		auto perRow = gVoleBlocksPerRow + 2 + (mMaxVoleParts > 1);
+		return (paxos.size() * perRow + numKeys) * sizeof(block);
+	}
+
+	Proto OprfServer::serve(u64 recverSize, span<const block> keys, span<block> outputs, Socket& chl, block seed)
+	{
+		auto bytes = u64{ 0 };
+		auto sender = std::unique_ptr<RsOprfSender>{};
+		auto prng = PRNG{};
+		auto ex = std::exception_ptr{};
+
+		if (keys.size() != outputs.size())
+			throw RTE_LOC;
+
+		bytes = sessionMemory(recverSize, keys.size());
+		if (bytes > mMemoryBudget)
+			throw std::runtime_error("an oprf session of " + std::to_string(bytes) + " bytes does not fit in the memory budget. " LOCATION);
+
+		co_await(Admit{ *this, bytes });
+
+		// a waiting session is resumed by the one that released its
+		// memory. Move back onto the executor.
+		co_await(mExecutor->schedule());
+
+		try
+		{
+			sender.reset(new RsOprfSender);
+			sender->mBinSize = mBinSize;
+			sender->mWeight = mWeight;
+			sender->mSsp = mSsp;
+			sender->mMalicious = mMalicious;
+			sender->mMaxVoleParts = mMaxVoleParts;
+			sender->mExecutor = mExecutor;
+			sender->setMultType(mMultType);
+			prng.SetSeed(seed);
+
+			co_await(sender->send(recverSize, prng, chl, mSessionThreads));
+			sender->eval(keys, outputs, mSessionThreads);
+		}
+		catch (...)
+		{
+			ex = std::current_exception();
+		}
+
+		sender.reset();
+		release(bytes);
+
+		if (ex)
+			std::rethrow_exception(ex);
+	}
+
+	bool OprfServer::tryAdmit(u64 bytes)
+	{
+		if (mActive >= mMaxSessions || mMemory + bytes > mMemoryBudget)
+			return false;
+
+		++mActive;
+		mMemory += bytes;
+		mPeak = std::max(mPeak, mActive);
+		return true;
+	}
+
+	bool OprfServer::Admit::await_ready()
+	{
+		std::lock_guard<std::mutex> lock(mServer.mMtx);
+
+		// sessions that wait are admitted first.
+		return mServer.mWaiting.empty() && mServer.tryAdmit(mBytes);
+	}
+
+	bool OprfServer::Admit::await_suspend(std::coroutine_handle<> h)
+	{
+		std::lock_guard<std::mutex> lock(mServer.mMtx);
+		if (mServer.mWaiting.empty() && mServer.tryAdmit(mBytes))
+			return false;
+
+		mServer.mWaiting.push_back({ mBytes, h });
+		return true;
+	}
+
+	void OprfServer::release(u64 bytes)
+	{
+		std::vector<std::coroutine_handle<>> admitted;
+		{
+			std::lock_guard<std::mutex> lock(mMtx);
+			--mActive;
+			mMemory -= bytes;
+
+			while (mWaiting.size() && tryAdmit(mWaiting.front().mBytes))
+			{
+				admitted.push_back(mWaiting.front().mHandle);
+				mWaiting.pop_front();
+			}
+		}
+
+		// each resumed session moves itself onto the executor.
+		for (auto h : admitted)
+			h.resume();
+	}
+
+	u64 OprfServer::activeSessions() const
+	{
+		std::lock_guard<std::mutex> lock(mMtx);
+		return mActive;
+	}
+
+	u64 OprfServer::memoryInUse() const
+	{
+		std::lock_guard<std::mutex> lock(mMtx);
+		return mMemory;
+	}
+
+	u64 OprfServer::peakSessions() const
+	{
+		std::lock_guard<std::mutex> lock(mMtx);
+		return mPeak;
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "Defines.h"
+#include "RsOprf.h"
+#include <macoro/thread_pool.h>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+
+namespace volePSI
+{
+	// Serves many OPRF sessions at the same time. Each session is the
+	// sender side of RsOprfSender::send(...) over its own socket followed
+	// by eval(...) of the server's keys. The coroutines of all sessions
+	// run on one shared executor. A session is admitted once fewer than
+	// mMaxSessions are running and its estimated memory, see
+	// sessionMemory(...), fits in what is left of mMemoryBudget. Sessions
+	// that do not fit wait in the order they arrived.
+	class OprfServer
+	{
+	public:
+		// the oprf parameters, the same for every session. The receivers
+		// must use the same.
+		u64 mBinSize = 1 << 14;
+		u64 mWeight = 3;
+		u64 mSsp = 40;
+		bool mMalicious = false;
+		oc::MultType mMultType = oc::DefaultMultType;
+
+		// the threads that a session uses for its paxos and hashing, from
+		// threadPool(). The protocol itself runs on the executor.
+		u64 mSessionThreads = 1;
+
+		// the most parts a receiver may split a session's vole into, see
+		// RsOprfSender::mMaxVoleParts. The parts run on the executor and
+		// a split vole is copied once, see sessionMemory(...).
+		u64 mMaxVoleParts = 1;
+
+		// the limits on the admitted sessions.
+		u64 mMaxSessions = 64;
+		u64 mMemoryBudget = 8ull << 30;
+
+		OprfServer(macoro::thread_pool& executor)
+			: mExecutor(&executor)
+		{}
+		OprfServer(const OprfServer&) = delete;
+
+		// serve a receiver with recverSize keys over chl. outputs[i] is
+		// set to the oprf of keys[i]. Completes once the session has been
+		// admitted and run. Throws if the session alone does not fit in
+		// mMemoryBudget.
+		Proto serve(u64 recverSize, span<const block> keys, span<block> outputs, Socket& chl, block seed);
+
+		// the estimated peak memory of a session in bytes.
+		u64 sessionMemory(u64 recverSize, u64 numKeys) const;
+
+		// the number of running sessions and their estimated memory.
+		u64 activeSessions() const;
+		u64 memoryInUse() const;
+
+		// the most sessions that have run at the same time.
+		u64 peakSessions() const;
+
+	private:
+		macoro::thread_pool* mExecutor;
+
+		mutable std::mutex mMtx;
+		u64 mActive = 0, mMemory = 0, mPeak = 0;
+
+		// the sessions waiting to be admitted and their memory.
+		struct Waiter
+		{
+			u64 mBytes;
+			std::coroutine_handle<> mHandle;
+		};
+		std::deque<Waiter> mWaiting;
+
+		// completes once bytes are admitted.
+		struct Admit
+		{
+			OprfServer& mServer;
+			u64 mBytes;
+
+			bool await_ready();
+			bool await_suspend(std::coroutine_handle<> h);
+			void await_resume() {}
+		};
+
+		// admit bytes if they fit. The caller holds mMtx.
+		bool tryAdmit(u64 bytes);
+
+		// end a session that was admitted with bytes and admit the
+		// waiting sessions that now fit.
+		void release(u64 bytes);
+	};
+}
@@ -7,6 +7,9 @@
 #include <numeric>
 #include <iomanip>
 #include <cmath>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
 
 #include "Defines.h"
 
@@ -17,6 +20,7 @@
 #include <cryptoTools/Crypto/RandomOracle.h>
 #include <libOTe/Tools/LDPC/Mtx.h>
 #include "PxUtil.h"
+#include "Numa.h"
 
 namespace volePSI
 {
@@ -56,6 +60,32 @@ namespace volePSI
 	};
 
 
+	template<typename IdxType>
+	struct PaxosPlan;
+
+	// thrown when the keys give a paxos system that can not be solved,
+	// i.e. the gap is larger than the dense part or the dense part is 
+	// not invertible. Other keys or another seed may succeed.
+	class PaxosSolveError : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	// The SIMD kernels that Paxos::decode32(...) can use when the values
+	// are blocks. The best kernel that the cpu supports is selected at 
+	// runtime, see paxosDecodeIsa().
+	enum class PaxosDecodeIsa
+	{
+		Scalar,
+		Avx2,
+		Avx512
+	};
+
+	// the kernel used by Paxos::decode32(...). Can be set to a lower 
+	// value to force a specific kernel.
+	inline PaxosDecodeIsa& paxosDecodeIsa();
+
 	// The core Paxos algorithm. The template parameter
 	// IdxType should be in {u8,u16,u32,u64} and large
 	// enough to fit the paxos size value.
@@ -77,11 +107,15 @@ namespace volePSI
 		// output, as opposed to overwriting.
 		bool mAddToDecode = false;
 
+		// the number of threads that setInput(...), triangulate(...) 
+		// and the gap solve may use. Small inputs use one thread. 
+		u64 mNumThreads = 1;
+
 		// the method for generating the row data based on the input value.
 		PaxosHash<IdxType> mHasher;
 
 		// an allocate used for the encoding algorithm
-		std::unique_ptr<u8[]> mAllocation;
+		AllocBuffer<u8> mAllocation;
 		u64 mAllocationSize = 0;
 
 		// The dense part of the paxos matrix
@@ -99,6 +133,11 @@ namespace volePSI
 		// A data structure used to track the current weight of the rows.s
 		WeightData<IdxType> mWeightSets;
 
+		// the column weights and the number of keys added so far 
+		// while the input is given in chunks, see beginInput(...).
+		std::vector<IdxType> mInputColWeights;
+		u64 mInputPos = 0;
+
 		Paxos() = default;
 		Paxos(const Paxos&) = default;
 		Paxos(Paxos&&) = default;
@@ -146,6 +185,24 @@ namespace volePSI
 		// encode can be called more than once.
 		void setInput(span<const block> inputs);
 
+		// begin setting the input keys in chunks. At most n keys can 
+		// be added with addInputs(...) and n should not be more than
+		// the paxos can hold. The rows are hashed as the keys are added 
+		// and the keys themselves are not kept.
+		void beginInput(u64 n);
+
+		// hash the next chunk of input keys into the paxos matrix.
+		void addInputs(span<const block> inputs);
+
+		// same as addInputs(...) but given the hash of each key under 
+		// mHasher, e.g. the hash that Baxos selects the bin with. 
+		void addHashes(span<const block> hashes);
+
+		// build the columns of the paxos matrix once all keys have been 
+		// added. The number of keys that were added becomes the number
+		// of items. After that, encode can be called more than once.
+		void finishInput();
+
 		// encode the given inputs,value pair based on the already set input. The paxos data 
 		// structure is written to output. input,value should be numItems 
 		// in size, output should be Paxos::size() in size. If the paxos
@@ -203,6 +260,67 @@ namespace volePSI
 		template<typename Vec, typename ConstVec, typename Helper>
 		void encode(ConstVec& values, Vec& output, Helper& h, oc::PRNG* prng = nullptr);
 
+		// triangulate the paxos matrix defined by setInput(...). The returned
+		// plan can be passed to encode(...) any number of times so that only
+		// the back substitution is performed for each set of values. The plan
+		// is valid as long as the input is not changed.
+		PaxosPlan<IdxType> getPlan();
+
+		// encode the given values using a plan from getPlan(). The paxos data 
+		// structure is written to output. value should be numItems in size, 
+		// output should be Paxos::size() in size. If the paxos should be 
+		// randomized, then provide a PRNG.
+		template<typename ValueType>
+		void encode(const PaxosPlan<IdxType>& plan, span<const ValueType> values, span<ValueType> output, oc::PRNG* prng = nullptr)
+		{
+			PxVector<const ValueType> V(values);
+			PxVector<ValueType> P(output);
+			auto h = P.defaultHelper();
+			encode(plan, V, P, h, prng);
+		}
+
+		// encode the given values using a plan from getPlan(). The paxos data 
+		// structure is written to output. values should have numItems 
+		// rows, output should have Paxos::size() rows. Both should have the 
+		// same number of columns. If the paxos should be randomized, then 
+		// provide a PRNG.
+		template<typename ValueType>
+		void encode(const PaxosPlan<IdxType>& plan, MatrixView<const ValueType> values, MatrixView<ValueType> output, oc::PRNG* prng = nullptr)
+		{
+			if (values.cols() != output.cols())
+				throw RTE_LOC;
+
+			if (values.cols() == 1)
+			{
+				encode(plan, span<const ValueType>(values), span<ValueType>(output), prng);
+			}
+			else if (
+				values.cols() * sizeof(ValueType) % sizeof(block) == 0 &&
+				std::is_same<ValueType, block>::value == false)
+			{
+				auto n = values.rows();
+				auto m = values.cols() * sizeof(ValueType) / sizeof(block);
+
+				encode<block>(
+					plan,
+					MatrixView<const block>((block*)values.data(), n, m),
+					MatrixView<block>((block*)output.data(), output.rows(), m),
+					prng);
+			}
+			else
+			{
+				PxMatrix<const ValueType> V(values);
+				PxMatrix<ValueType> P(output);
+				auto h = P.defaultHelper();
+				encode(plan, V, P, h, prng);
+			}
+		}
+
+		// encode the given values using a plan from getPlan(). Vec and ConstVec should
+		// meet the PxVector concept... Helper used to perform operations on values.
+		template<typename Vec, typename ConstVec, typename Helper>
+		void encode(const PaxosPlan<IdxType>& plan, ConstVec& values, Vec& output, Helper& h, oc::PRNG* prng = nullptr);
+
 		// Decode the given input based on the data paxos structure p. The
 		// output is written to values.
 		template<typename ValueType>
@@ -252,14 +370,18 @@ namespace volePSI
 		// decodes 32 instances. rows should contain the row indicies, dense the dense 
 		// part. values is where the values are written to. p is the Paxos, h is the value op. helper.
 		template<typename ValueType, typename Helper, typename Vec>
-		void decode32(const IdxType* rows, const block* dense, ValueType* values, Vec& p, Helper& h);
+		void decode32(const IdxType* rows, const block* dense, ValueType* values, Vec& p, Helper& h) const;
 
 		// decodes 8 instances. rows should contain the row indicies, dense the dense 
 		// part. values is where the values are written to. p is the Paxos, h is the value op. helper.
 		template<typename ValueType, typename Helper, typename Vec>
-		void decode8(const IdxType* rows, const block* dense, ValueType* values, Vec& p, Helper& h);
+		void decode8(const IdxType* rows, const block* dense, ValueType* values, Vec& p, Helper& h) const;
 
 
+		// decodes n block values, n a multiple of 8, using the kernel selected by
+		// paxosDecodeIsa(). Returns false if no SIMD kernel is available.
+		bool decodeBlocks(const IdxType* rows, const block* dense, block* values, const block* p, u64 n) const;
+
 		// decodes one instances. rows should contain the row indicies, dense the dense 
 		// part. values is where the values are written to. p is the Paxos, h is the value op. helper.
 		template<typename ValueType, typename Helper, typename Vec>
@@ -268,7 +390,7 @@ namespace volePSI
 			const block* dense,
 			ValueType* values,
 			Vec& p,
-			Helper& h);
+			Helper& h) const;
 
 		// manually set the row indicies and the dense values.
 		void setInput(MatrixView<IdxType> rows, span<block> dense);
@@ -291,13 +413,21 @@ namespace volePSI
 			std::vector<IdxType>& mainCols,
 			std::vector<std::array<IdxType, 2>>& gapRows);
 
+		// peel the weight one columns in parallel rounds using mNumThreads
+		// threads. The peeled rows/columns are appended to mainRows/mainCols
+		// and rowSet marks the rows that have been fixed. mWeightSets is 
+		// left holding the remaining columns so that the serial triangulation
+		// can finish the job.
+		void parallelPeel(
+			std::vector<IdxType>& mainRows,
+			std::vector<IdxType>& mainCols,
+			std::vector<u8>& rowSet);
+
 		// once triangulated, this is used to assign values 
 		// to output (paxos).
 		template<typename Vec, typename ConstVec, typename Helper>
 		void backfill(
-			span<IdxType> mainRows,
-			span<IdxType> mainCols,
-			span<std::array<IdxType, 2>> gapRows,
+			const PaxosPlan<IdxType>& plan,
 			ConstVec& values,
 			Vec& output,
 			Helper& h,
@@ -307,9 +437,7 @@ namespace volePSI
 		// to output (paxos). Use the gf128 dense algorithm.
 		template<typename Vec, typename ConstVec, typename Helper>
 		void backfillGf128(
-			span<IdxType> mainRows,
-			span<IdxType> mainCols,
-			span<std::array<IdxType, 2>> gapRows,
+			const PaxosPlan<IdxType>& plan,
 			ConstVec& values,
 			Vec& output,
 			Helper& h,
@@ -319,9 +447,7 @@ namespace volePSI
 		// to output (paxos). Use the classic binary dense algorithm.
 		template<typename Vec, typename ConstVec, typename Helper>
 		void backfillBinary(
-			span<IdxType> mainRows,
-			span<IdxType> mainCols,
-			span<std::array<IdxType, 2>> gapRows,
+			const PaxosPlan<IdxType>& plan,
 			ConstVec& values,
 			Vec& output,
 			Helper&h,
@@ -342,9 +468,14 @@ namespace volePSI
 		// the row data has been populated (via setInput(...)).
 		void rebuildColumns(span<IdxType> colWeights, u64 totalWeight);
 
+		// add the number of times each column appears in rows to colWeights.
+		// With mNumThreads threads, each thread counts its own range of columns.
+		void countColumns(MatrixView<const IdxType> rows, span<IdxType> colWeights) const;
+
 		// A sparse representation of the F * C^-1 matrix.
 		struct FCInv
 		{
+			FCInv() = default;
 			FCInv(u64 n)
 				: mMtx(n)
 			{}
@@ -360,27 +491,33 @@ namespace volePSI
 		// returns which columns are used for the gap. This
 		// is only used for binary dense method.
 		std::vector<u64> getGapCols(
-			FCInv& fcinv,
-			span<std::array<IdxType, 2>> gapRows) const;
+			const FCInv& fcinv,
+			span<const std::array<IdxType, 2>> gapRows) const;
 
 		// returns x2' = x2 - D' r - FC^-1 x1
 		template<typename Vec, typename ConstVec, typename Helper>
 		Vec getX2Prime(
-			FCInv &fcinv,
-			span<std::array<IdxType, 2>> gapRows, 
-			span<u64> gapCols,
+			const FCInv &fcinv,
+			span<const std::array<IdxType, 2>> gapRows, 
+			span<const u64> gapCols,
 			const ConstVec& X,
 			const Vec& P,
 			Helper& h);
 
 		// returns E' = -FC^-1B + E
 		oc::DenseMtx getEPrime(
-			FCInv &fcinv,
-			span<std::array<IdxType, 2>> gapRows,
-			span<u64> gapCols);
+			const FCInv &fcinv,
+			span<const std::array<IdxType, 2>> gapRows,
+			span<const u64> gapCols);
+
+		// returns the g x mDenseSize matrix E' = -FC^-1B + E
+		// for the gf128 dense algorithm.
+		Matrix<block> getEPrimeGf128(
+			const FCInv& fcinv,
+			span<const std::array<IdxType, 2>> gapRows);
 
 		template<typename Vec, typename Helper>
-		void randomizeDenseCols(Vec&, Helper&, span<u64> gapCols, oc::PRNG* prng);
+		void randomizeDenseCols(Vec&, Helper&, span<const u64> gapCols, oc::PRNG* prng);
 
 
 
@@ -409,6 +546,86 @@ namespace volePSI
 
 	};
 
+	// The triangulation of a paxos matrix along with the inverse
+	// needed to solve the gap, see Paxos::getPlan(). These only 
+	// depend on the keys and therefore the plan can be reused to 
+	// encode any number of value vectors.
+	template<typename IdxType>
+	struct PaxosPlan
+	{
+		// the number of items that the plan was made for.
+		u64 mNumItems = 0;
+
+		// the rows/columns of the lower triangular matrix C.
+		std::vector<IdxType> mMainRows, mMainCols;
+
+		// the rows that are in the gap.
+		std::vector<std::array<IdxType, 2>> mGapRows;
+
+		// the sparse columns that were not assigned a row. These
+		// are randomized if a randomized paxos is desired.
+		std::vector<IdxType> mFreeCols;
+
+		// the sparse representation of F * C^-1.
+		typename Paxos<IdxType>::FCInv mFCInv;
+
+		// binary dense only. The dense columns which index 
+		// the gap and the inverse of E' restricted to them.
+		std::vector<u64> mGapCols;
+		oc::DenseMtx mBinEEInv;
+
+		// gf128 dense only. E' = E - FC^-1 B with mDenseSize columns
+		// and the inverse of its first g columns. mEEInv is empty 
+		// if this g x g matrix is not invertible.
+		Matrix<block> mEE, mEEInv;
+	};
+
+	// The plan for a single bin of a Baxos.
+	template<typename IdxType>
+	struct BaxosBinPlan
+	{
+		// the paxos which holds the rows of this bin.
+		Paxos<IdxType> mPaxos;
+
+		// the triangulation of mPaxos.
+		PaxosPlan<IdxType> mPlan;
+	};
+
+	// The per bin triangulation of a Baxos, see Baxos::getPlan(...).
+	struct BaxosPlan
+	{
+		// the number of items that the plan was made for.
+		u64 mNumItems = 0;
+
+		// the input index of each item grouped by bin. The items of 
+		// bin i are at mInputIdxs[mBinBegin[i]] ... mInputIdxs[mBinBegin[i+1]-1].
+		// While the keys are added in chunks (see Baxos::beginInput(...)), 
+		// mNumItems is the number added so far, mBinBegin is empty and the
+		// items of bin i start at mInputIdxs[i * Baxos::mItemsPerBin].
+		std::vector<u64> mInputIdxs, mBinBegin;
+
+		// the per bin plans. Only the vector matching the index 
+		// type that Baxos selected is populated.
+		std::vector<BaxosBinPlan<u8>> mBins8;
+		std::vector<BaxosBinPlan<u16>> mBins16;
+		std::vector<BaxosBinPlan<u32>> mBins32;
+		std::vector<BaxosBinPlan<u64>> mBins64;
+
+		// returns the per bin plans for the given index type.
+		template<typename IdxType>
+		std::vector<BaxosBinPlan<IdxType>>& bins()
+		{
+			if constexpr (std::is_same<IdxType, u8>::value)
+				return mBins8;
+			else if constexpr (std::is_same<IdxType, u16>::value)
+				return mBins16;
+			else if constexpr (std::is_same<IdxType, u32>::value)
+				return mBins32;
+			else
+				return mBins64;
+		}
+	};
+
 	// a binned version of paxos. Internally calls paxos.
 	class Baxos
 	{
@@ -425,6 +642,65 @@ namespace volePSI
 		// output, as opposed to overwriting.
 		bool mAddToDecode = false;
 
+		// the work done by a thread while solving the bins.
+		struct ThreadStats
+		{
+			u64 mNumBins = 0;
+			std::chrono::steady_clock::duration mTime{};
+		};
+
+		// the per thread stats of the last multi bin solve(...), empty
+		// after a single bin solve. Shows the load imbalance between the
+		// threads.
+		std::vector<ThreadStats> mThrdSolveStats;
+
+		// on machines with several numa nodes, split the bins into one 
+		// range per node. The part of p that holds a range is placed on 
+		// its node and the threads that solve or decode its bins are 
+		// pinned to that node. See Numa.h.
+		bool mNuma = false;
+
+		// decode by first partitioning a chunk of inputs by bin and then
+		// decoding each bin's run at once, instead of buffering up to 512
+		// inputs for every bin. Each thread uses a fixed 4MB of scratch
+		// plus 16 bytes per bin, and the p of one bin stays in cache
+		// while its run is decoded.
+		bool mPartitionDecode = false;
+
+		// when a bin fails to solve, e.g. its gap is too large, re-solve 
+		// just that bin with its keys hashed again under a seed derived 
+		// from mSeed, up to this many times (at most 255). 0 fails the 
+		// solve as before. Only a PaxosSolveError is retried. Only a 
+		// multi bin solve(...) retries. With a single bin, or with the
+		// plan based encode(...), a failure is thrown.
+		u64 mMaxBinRetries = 0;
+
+		// the retry that each bin was solved with by the last solve(...),
+		// or empty if none. A decoder needs these along with p, they are
+		// stored in paxos files.
+		std::vector<u8> mBinRetries;
+
+		// if set, solve(...) calls mOnBinsSolved(binBegin, binEnd) from a
+		// solving thread once every bin of [binBegin, binEnd) is solved, 
+		// for the consecutive ranges of mSolvedRangeBins bins. The part of
+		// the output that holds these bins is final from then on, e.g. it 
+		// can be sent while the other bins are being solved.
+		std::function<void(u64, u64)> mOnBinsSolved;
+		u64 mSolvedRangeBins = 1;
+
+		// the retry of binIdx, see mBinRetries.
+		u64 binRetries(u64 binIdx) const
+		{
+			return mBinRetries.size() ? mBinRetries[binIdx] : 0;
+		}
+
+		// the seed that the keys of binIdx are hashed again with on the 
+		// given retry.
+		block binSeed(u64 binIdx, u64 retry) const
+		{
+			return mSeed ^ block(retry, binIdx);
+		}
+
 		// initialize the paxos with the given parameter.
 		void init(u64 numItems, u64 binSize, u64 weight, u64 ssp, PaxosParam::DenseType dt, block seed)
 		{
@@ -476,6 +752,106 @@ namespace volePSI
 			Helper& h);
 
 
+		// triangulate each bin of the system defined by the given keys. 
+		// The returned plan can be passed to encode(...) any number of
+		// times to encode different values for these keys.
+		BaxosPlan getPlan(span<const block> inputs, u64 numThreads = 0);
+
+		// begin a plan whose keys are given in chunks. Each key is hashed
+		// into the paxos of its bin as it is added, so the keys do not 
+		// need to be held in memory. At most numItems keys can be added.
+		void beginInput(BaxosPlan& plan);
+
+		// add the next chunk of keys to plan. The i'th key added 
+		// corresponds to the i'th value given to encode(...).
+		void addInputs(BaxosPlan& plan, span<const block> inputs);
+
+		// triangulate each bin once all keys have been added. plan 
+		// can then be passed to encode(...). As with Paxos::finishInput(),
+		// the number of keys that were added becomes mNumItems.
+		void finishInput(BaxosPlan& plan, u64 numThreads = 0);
+
+		// encode the values for the keys that plan was made for. The i'th
+		// value corresponds to the i'th key given to getPlan(...).
+		// output is the paxos.
+		// prng should be non-null if randomized paxos is desired.
+		template<typename ValueType>
+		void encode(
+			BaxosPlan& plan,
+			span<const ValueType> values,
+			span<ValueType> output,
+			oc::PRNG* prng = nullptr,
+			u64 numThreads = 0);
+
+		// encode the value matrix for the keys that plan was made for. 
+		// The i'th row corresponds to the i'th key given to getPlan(...).
+		// output is the paxos.
+		// prng should be non-null if randomized paxos is desired.
+		template<typename ValueType>
+		void encode(
+			BaxosPlan& plan,
+			MatrixView<const ValueType> values,
+			MatrixView<ValueType> output,
+			oc::PRNG* prng = nullptr,
+			u64 numThreads = 0);
+
+		// encode the values for the keys that plan was made for.
+		template<typename Vec, typename ConstVec, typename Helper>
+		void encode(
+			BaxosPlan& plan,
+			ConstVec& values,
+			Vec& output,
+			oc::PRNG* prng,
+			u64 numThreads,
+			Helper& h);
+
+		// update the paxos p, which encodes the keys of plan, so that the 
+		// removeKeys are dropped and insertKeys decode to insertValues. The 
+		// values of the remaining keys are decoded from p and only the bins 
+		// which contain an inserted or removed key are re-solved. plan is 
+		// updated to the new key set, ordered as the old keys without 
+		// removeKeys followed by insertKeys. Returns the [begin, end) ranges
+		// of p that were changed. If it throws, p and plan are unchanged.
+		//
+		// A bin holds at most mItemsPerBin keys, an update that grows a bin
+		// beyond that throws. With a single bin mItemsPerBin is mNumItems, 
+		// so the number of keys can not grow. Re-init with a larger size and
+		// solve instead.
+		template<typename ValueType>
+		std::vector<std::pair<u64, u64>> update(
+			BaxosPlan& plan,
+			span<const block> insertKeys,
+			span<const ValueType> insertValues,
+			span<const block> removeKeys,
+			span<ValueType> p,
+			oc::PRNG* prng = nullptr,
+			u64 numThreads = 0);
+
+		// update the paxos matrix p, see above. The i'th row of 
+		// insertValues is the value of insertKeys[i]. The returned
+		// ranges are in rows of p.
+		template<typename ValueType>
+		std::vector<std::pair<u64, u64>> update(
+			BaxosPlan& plan,
+			span<const block> insertKeys,
+			MatrixView<const ValueType> insertValues,
+			span<const block> removeKeys,
+			MatrixView<ValueType> p,
+			oc::PRNG* prng = nullptr,
+			u64 numThreads = 0);
+
+		// update the paxos p, see above.
+		template<typename Vec, typename ConstVec, typename Helper>
+		std::vector<std::pair<u64, u64>> update(
+			BaxosPlan& plan,
+			span<const block> insertKeys,
+			ConstVec& insertValues,
+			span<const block> removeKeys,
+			Vec& p,
+			oc::PRNG* prng,
+			u64 numThreads,
+			Helper& h);
+
 		// decode a single input given the paxos p.
 		template<typename ValueType>
 		ValueType decode(const block& input, span<const ValueType> p)
@@ -526,6 +902,79 @@ namespace volePSI
 			u64 numThreads,
 			Helper& h);
 
+		// the number of bytes of scratch memory that implSolveBin needs.
+		template<typename IdxType>
+		u64 binSolveAllocSize() const;
+
+		// solve bin binIdx given the hashes of its keys and their values.
+		// output is the bin's part of the paxos. allocation must hold 
+		// binSolveAllocSize<IdxType>() bytes. If solving fails, the hashes
+		// are hashed again with binSeed(binIdx, retry) up to mMaxBinRetries
+		// times. Returns the retry that succeeded, hashes then holds the
+		// hashes that were solved for.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		u64 implSolveBin(
+			u64 binIdx,
+			span<block> hashes,
+			ConstVec& values,
+			Vec& output,
+			oc::PRNG* prng,
+			Helper& h,
+			Paxos<IdxType>& paxos,
+			u8* allocation);
+
+		// a single attempt of implSolveBin.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		void implSolveBinOnce(
+			span<block> hashes,
+			ConstVec& values,
+			Vec& output,
+			oc::PRNG* prng,
+			Helper& h,
+			Paxos<IdxType>& paxos,
+			u8* allocation);
+
+		// map the inputs to their bins and triangulate each bin.
+		template<typename IdxType>
+		void implGetPlan(
+			span<const block> inputs,
+			BaxosPlan& plan,
+			u64 numThreads);
+
+		// initialize the per bin paxos for chunked input.
+		template<typename IdxType>
+		void implBeginInput(BaxosPlan& plan);
+
+		// hash the keys into the paxos of their bins.
+		template<typename IdxType>
+		void implAddInputs(BaxosPlan& plan, span<const block> inputs);
+
+		// group the input indices by bin and triangulate each bin.
+		template<typename IdxType>
+		void implFinishInput(BaxosPlan& plan, u64 numThreads);
+
+		// encode the values using the per bin plans.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		void implParEncode(
+			BaxosPlan& plan,
+			ConstVec& values,
+			Vec& output,
+			oc::PRNG* prng,
+			u64 numThreads,
+			Helper& h);
+
+		// re-solve the bins which have inserted or removed keys.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		std::vector<std::pair<u64, u64>> implUpdate(
+			BaxosPlan& plan,
+			span<const block> insertKeys,
+			ConstVec& insertValues,
+			span<const block> removeKeys,
+			Vec& p,
+			oc::PRNG* prng,
+			u64 numThreads,
+			Helper& h);
+
 		// create the desired number of threads and split up the work.
 		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
 		void implParDecode(
@@ -537,8 +986,59 @@ namespace volePSI
 
 
 		// decode the given inputs based on the paxos p. The output is written to values.
+		// Only the inputs that map to a bin in [binBegin, binEnd) are decoded.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		void implDecodeBatch(span<const block> inputs, Vec& values, ConstVec& p, Helper& h,
+			u64 binBegin = 0, u64 binEnd = ~0ull);
+
+		// the largest number of inputs that decode(...) handles with
+		// implDecodeSmall.
+		static constexpr const u64 smallDecodeSize = 32;
+
+		// decode at most smallDecodeSize inputs on the calling thread, one
+		// at a time. Unlike implDecodeBatch nothing is sized by the number
+		// of bins. For repeated lookups, BaxosDecoder also avoids the setup.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+		void implDecodeSmall(span<const block> inputs, Vec& values, ConstVec& p, Helper& h);
+
+		// decode the keys with the given bin hashes one at a time into 
+		// values[valueBegin + i]. binIdxs[i] is the bin of hashes[i] and 
+		// rehash(binIdx, hash) applies the retry of the bin, if any. paxos
+		// has the parameters of a bin, whose part of p is sizePer rows.
+		// Shared by implDecodeSmall and BaxosDecoder.
+		template<typename IdxType, typename Vec, typename ConstVec, typename Helper, typename Rehash>
+		static void decodeBinHashes(
+			const Paxos<IdxType>& paxos,
+			span<block> hashes,
+			const u64* binIdxs,
+			u64 sizePer,
+			bool addToDecode,
+			Vec& values,
+			u64 valueBegin,
+			ConstVec& p,
+			Helper& h,
+			Rehash&& rehash);
+
+		// decode the given inputs based on the paxos p. Same as implDecodeBatch
+		// but the inputs are radix partitioned by bin a chunk at a time.
 		template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
-		void implDecodeBatch(span<const block> inputs, Vec& values, ConstVec& p, Helper& h);
+		void implDecodePartitioned(span<const block> inputs, Vec& values, ConstVec& p, Helper& h,
+			u64 binBegin = 0, u64 binEnd = ~0ull);
+
+		// place the part of p that holds the bins of each node of split on that node.
+		template<typename Vec>
+		void numaBindBins(Vec& p, const NumaBinSplit& split)
+		{
+			auto sizePer = mPaxosParam.size();
+			auto rowBytes = (const u8*)p[1] - (const u8*)p[0];
+			for (u64 k = 0; k < split.numNodes(); ++k)
+			{
+				auto b = split.mBinBegin[k] * sizePer;
+				auto e = split.mBinBegin[k + 1] * sizePer;
+				if (b != e)
+					numaBind(p[b], (const u8*)p[e - 1] + rowBytes, k);
+			}
+		}
 
 		// decode the given inputs based on the paxos p. The output is written to values.
 		// this differs from implDecode in that all inputs must be for the same paxos bin.
@@ -561,12 +1061,12 @@ namespace volePSI
 
 		static u64 getBinSize(u64 numBins, u64 numItems, u64 ssp);
 
-		u64 binIdxCompress(const block& h)
+		static u64 binIdxCompress(const block& h)
 		{
 			return (h.get<u64>(0) ^ h.get<u64>(1) ^ h.get<u32>(3));
 		}
 
-		u64 modNumBins(const block& h)
+		u64 modNumBins(const block& h) const
 		{
 			return binIdxCompress(h) % mNumBins;
 		}
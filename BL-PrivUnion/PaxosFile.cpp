@@ -0,0 +1,240 @@
+#include "PaxosFile.h"
+#include <fstream>
+#include <cstring>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace volePSI
+{
+	namespace
+	{
+		// true if a * b does not fit in a u64.
+		bool mulOverflows(u64 a, u64 b)
+		{
+			return a && b > ~0ull / a;
+		}
+	}
+
+	PaxosParam PaxosFileHeader::paxosParam() const
+	{
+		PaxosParam p;
+		p.mSparseSize = mSparseSize;
+		p.mDenseSize = mDenseSize;
+		p.mWeight = mWeight;
+		p.mG = mG;
+		p.mSsp = mSsp;
+		p.mDt = static_cast<PaxosParam::DenseType>(mDenseType);
+		return p;
+	}
+
+	void PaxosFileHeader::validate() const
+	{
+		if (mMagic != Magic)
+			throw std::runtime_error("not a paxos encoding file. " LOCATION);
+		if (mVersion == 0 || mVersion > CurrentVersion)
+			throw std::runtime_error("unsupported paxos encoding file version " + std::to_string(mVersion) + ". " LOCATION);
+		if (mHeaderSize < sizeof(PaxosFileHeader) || mDataOffset < mHeaderSize)
+			throw std::runtime_error("bad paxos encoding file header size. " LOCATION);
+		if (mKind != PaxosKind && mKind != BaxosKind)
+			throw std::runtime_error("unknown paxos encoding kind. " LOCATION);
+		if (mDenseType != PaxosParam::Binary && mDenseType != PaxosParam::GF128)
+			throw std::runtime_error("unknown paxos dense type. " LOCATION);
+		if (mIdxBytes != 1 && mIdxBytes != 2 && mIdxBytes != 4 && mIdxBytes != 8)
+			throw std::runtime_error("bad paxos index type size. " LOCATION);
+		if (mHasBinRetries > 1 || (mHasBinRetries && (mVersion < 2 || mKind != BaxosKind)))
+			throw std::runtime_error("bad paxos bin retries flag. " LOCATION);
+		// the sizes come from the file, none of the products or sums 
+		// below may wrap. Then dataSize() does not wrap either.
+		if (mSparseSize > ~0ull - mDenseSize ||
+			mulOverflows(mNumBins, mSparseSize + mDenseSize) ||
+			mulOverflows(mNumRows, mRowBytes) ||
+			mNumRows * mRowBytes > ~0ull - mNumBins)
+			throw std::runtime_error("paxos encoding file header sizes overflow. " LOCATION);
+		if (mRowBytes == 0 || mNumBins == 0 ||
+			mNumRows != mNumBins * (mSparseSize + mDenseSize))
+			throw std::runtime_error("inconsistent paxos encoding file header. " LOCATION);
+	}
+
+	void writePaxosFile(const std::string& path, const Baxos& baxos, const u8* p, u64 numRows, u64 rowBytes)
+	{
+		if (numRows != baxos.mNumBins * baxos.mPaxosParam.size())
+			throw RTE_LOC;
+
+		auto header = paxosFileHeader(baxos, rowBytes);
+		details::writePaxosFile(path, header, p, baxos.mBinRetries.data());
+	}
+
+	PaxosFileHeader paxosFileHeader(const Baxos& baxos, u64 rowBytes)
+	{
+		auto& pp = baxos.mPaxosParam;
+		PaxosFileHeader header;
+		header.mKind = PaxosFileHeader::BaxosKind;
+		header.mDenseType = static_cast<u8>(pp.mDt);
+		header.mIdxBytes = static_cast<u8>(oc::roundUpTo(oc::log2ceil(pp.mSparseSize + 1), 8) / 8);
+		header.mRowBytes = static_cast<u32>(rowBytes);
+		header.mNumItems = baxos.mNumItems;
+		header.mNumBins = baxos.mNumBins;
+		header.mItemsPerBin = baxos.mItemsPerBin;
+		header.mWeight = baxos.mWeight;
+		header.mSsp = baxos.mSsp;
+		header.mSparseSize = pp.mSparseSize;
+		header.mDenseSize = pp.mDenseSize;
+		header.mG = pp.mG;
+		header.mSeed = { baxos.mSeed.get<u64>(0), baxos.mSeed.get<u64>(1) };
+		header.mNumRows = baxos.mNumBins * pp.size();
+		header.mHasBinRetries = baxos.mBinRetries.size() ? 1 : 0;
+		if (header.mHasBinRetries && baxos.mBinRetries.size() != baxos.mNumBins)
+			throw RTE_LOC;
+		return header;
+	}
+
+	namespace details
+	{
+		void writePaxosFile(const std::string& path, PaxosFileHeader& header, const u8* p, const u8* binRetries)
+		{
+			std::ofstream out(path, std::ios::binary | std::ios::trunc);
+			if (!out)
+				throw std::runtime_error("failed to open " + path + " for writing. " LOCATION);
+
+			writePaxosFileHeader(out, header);
+			out.write((const char*)p, header.mNumRows * header.mRowBytes);
+			if (header.mHasBinRetries)
+				out.write((const char*)binRetries, header.mNumBins);
+			out.flush();
+
+			if (!out)
+				throw std::runtime_error("failed to write " + path + ". " LOCATION);
+		}
+
+		void writePaxosFileHeader(std::ostream& out, PaxosFileHeader& header)
+		{
+			if (header.mRowBytes == 0)
+				throw RTE_LOC;
+
+			header.mDataOffset = oc::roundUpTo(sizeof(PaxosFileHeader), PaxosFileHeader::DataAlignment);
+			header.validate();
+
+			std::vector<char> padding(header.mDataOffset - sizeof(PaxosFileHeader));
+			out.write((const char*)&header, sizeof(header));
+			out.write(padding.data(), padding.size());
+		}
+	}
+
+	MappedPaxosFile& MappedPaxosFile::operator=(MappedPaxosFile&& o)
+	{
+		if (this != &o)
+		{
+			close();
+			mHeader = o.mHeader;
+			mData = std::exchange(o.mData, nullptr);
+			mSize = std::exchange(o.mSize, 0);
+		}
+		return *this;
+	}
+
+	void MappedPaxosFile::open(const std::string& path)
+	{
+		close();
+
+#ifdef _WIN32
+		// no mmap, read the file onto the heap instead.
+		std::ifstream in(path, std::ios::binary | std::ios::ate);
+		if (!in)
+			throw std::runtime_error("failed to open " + path + ". " LOCATION);
+		mSize = in.tellg();
+		auto data = new u8[mSize];
+		in.seekg(0);
+		in.read((char*)data, mSize);
+		if (!in)
+		{
+			delete[] data;
+			throw std::runtime_error("failed to read " + path + ". " LOCATION);
+		}
+		mData = data;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("failed to open " + path + ". " LOCATION);
+
+		struct stat st;
+		if (fstat(fd, &st))
+		{
+			::close(fd);
+			throw std::runtime_error("failed to stat " + path + ". " LOCATION);
+		}
+		mSize = st.st_size;
+
+		void* ptr = mSize ? mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+
+		// the mapping stays valid after the file is closed.
+		::close(fd);
+
+		if (ptr == MAP_FAILED)
+		{
+			mSize = 0;
+			throw std::runtime_error("failed to map " + path + ". " LOCATION);
+		}
+
+		// decoding reads p at random locations.
+		madvise(ptr, mSize, MADV_RANDOM);
+		mData = (const u8*)ptr;
+#endif
+
+		try
+		{
+			if (mSize < sizeof(PaxosFileHeader))
+				throw std::runtime_error(path + " is too small to be a paxos encoding. " LOCATION);
+			std::memcpy(&mHeader, mData, sizeof(PaxosFileHeader));
+			mHeader.validate();
+
+			if (mHeader.mDataOffset % alignof(block) ||
+				mHeader.mDataOffset > mSize ||
+				mHeader.dataSize() > mSize - mHeader.mDataOffset)
+				throw std::runtime_error(path + " is truncated. " LOCATION);
+		}
+		catch (...)
+		{
+			close();
+			throw;
+		}
+	}
+
+	void MappedPaxosFile::close()
+	{
+		if (mData)
+		{
+#ifdef _WIN32
+			delete[] mData;
+#else
+			munmap((void*)mData, mSize);
+#endif
+		}
+		mData = nullptr;
+		mSize = 0;
+		mHeader = {};
+	}
+
+	void MappedPaxosFile::init(Baxos& baxos) const
+	{
+		if (mHeader.mKind != PaxosFileHeader::BaxosKind)
+			throw std::runtime_error("the file does not hold a Baxos encoding. " LOCATION);
+
+		baxos.mNumItems = mHeader.mNumItems;
+		baxos.mNumBins = mHeader.mNumBins;
+		baxos.mItemsPerBin = mHeader.mItemsPerBin;
+		baxos.mWeight = mHeader.mWeight;
+		baxos.mSsp = mHeader.mSsp;
+		baxos.mPaxosParam = mHeader.paxosParam();
+		baxos.mSeed = block(mHeader.mSeed[1], mHeader.mSeed[0]);
+		if (mHeader.mHasBinRetries)
+			baxos.mBinRetries.assign(binRetries(), binRetries() + mHeader.mNumBins);
+		else
+			baxos.mBinRetries.clear();
+	}
+}
@@ -0,0 +1,229 @@
+#pragma once
+#include "Defines.h"
+#include "Paxos.h"
+#include <ostream>
+#include <string>
+
+namespace volePSI
+{
+	// The header of a paxos/baxos encoding file. The file is
+	//
+	//   [PaxosFileHeader][padding][p][bin retries]
+	//
+	// where p is the raw paxos vector, mNumRows rows of mRowBytes bytes
+	// each, starting at the page aligned offset mDataOffset. If 
+	// mHasBinRetries is set, p is followed by the mNumBins bytes of 
+	// Baxos::mBinRetries. All integers are in the native byte order.
+	struct PaxosFileHeader
+	{
+		static constexpr std::array<char, 8> Magic{ 'v', 'p', 's', 'i', 'o', 'k', 'v', 's' };
+		static constexpr u32 CurrentVersion = 2;
+
+		// the alignment of the p data in the file.
+		static constexpr u64 DataAlignment = 4096;
+
+		enum Kind : u8
+		{
+			PaxosKind,
+			BaxosKind
+		};
+
+		std::array<char, 8> mMagic = Magic;
+		u32 mVersion = CurrentVersion;
+
+		// sizeof(PaxosFileHeader) of the writer. Later versions
+		// may only append fields.
+		u32 mHeaderSize = sizeof(PaxosFileHeader);
+
+		Kind mKind = PaxosKind;
+		u8 mDenseType = 0;
+
+		// sizeof(IdxType) of a Paxos or the index type that Baxos
+		// uses for its bins.
+		u8 mIdxBytes = 0;
+
+		// 1 if the per bin retries follow p. Added in version 2, 
+		// version 1 files have 0.
+		u8 mHasBinRetries = 0;
+
+		// the number of bytes of a single row of p, i.e.
+		// sizeof(ValueType) times the number of columns.
+		u32 mRowBytes = 0;
+
+		u64 mNumItems = 0;
+		u64 mNumBins = 0;
+		u64 mItemsPerBin = 0;
+		u64 mWeight = 0;
+		u64 mSsp = 0;
+		u64 mSparseSize = 0;
+		u64 mDenseSize = 0;
+		u64 mG = 0;
+		std::array<u64, 2> mSeed{};
+
+		// the number of rows of p.
+		u64 mNumRows = 0;
+
+		// the offset of p in the file.
+		u64 mDataOffset = 0;
+
+		// the number of bytes of p and the bin retries.
+		u64 dataSize() const { return mNumRows * mRowBytes + (mHasBinRetries ? mNumBins : 0); }
+
+		PaxosParam paxosParam() const;
+
+		// throws if the header is not a supported encoding header.
+		void validate() const;
+	};
+
+	// write the paxos p, with numRows rows of rowBytes bytes,
+	// and the parameters of paxos to path.
+	template<typename IdxType>
+	void writePaxosFile(const std::string& path, const Paxos<IdxType>& paxos, const u8* p, u64 numRows, u64 rowBytes);
+
+	// write the paxos p and the parameters of paxos to path.
+	template<typename IdxType, typename ValueType>
+	void writePaxosFile(const std::string& path, const Paxos<IdxType>& paxos, span<const ValueType> p)
+	{
+		writePaxosFile(path, paxos, (const u8*)p.data(), p.size(), sizeof(ValueType));
+	}
+
+	// write the paxos matrix p and the parameters of paxos to path.
+	template<typename IdxType, typename ValueType>
+	void writePaxosFile(const std::string& path, const Paxos<IdxType>& paxos, MatrixView<const ValueType> p)
+	{
+		writePaxosFile(path, paxos, (const u8*)p.data(), p.rows(), p.cols() * sizeof(ValueType));
+	}
+
+	// the header of a file that holds the p of baxos with rowBytes bytes per row.
+	PaxosFileHeader paxosFileHeader(const Baxos& baxos, u64 rowBytes);
+
+	// write the baxos p, with numRows rows of rowBytes bytes,
+	// and the parameters of baxos to path.
+	void writePaxosFile(const std::string& path, const Baxos& baxos, const u8* p, u64 numRows, u64 rowBytes);
+
+	// write the baxos p and the parameters of baxos to path.
+	template<typename ValueType>
+	void writePaxosFile(const std::string& path, const Baxos& baxos, span<const ValueType> p)
+	{
+		writePaxosFile(path, baxos, (const u8*)p.data(), p.size(), sizeof(ValueType));
+	}
+
+	// write the baxos matrix p and the parameters of baxos to path.
+	template<typename ValueType>
+	void writePaxosFile(const std::string& path, const Baxos& baxos, MatrixView<const ValueType> p)
+	{
+		writePaxosFile(path, baxos, (const u8*)p.data(), p.rows(), p.cols() * sizeof(ValueType));
+	}
+
+	// A read-only memory mapping of a file written by writePaxosFile(...).
+	// p() points into the mapping so that decoding does not copy p onto
+	// the heap, the pages are read on demand by the os.
+	class MappedPaxosFile
+	{
+	public:
+		MappedPaxosFile() = default;
+		MappedPaxosFile(const MappedPaxosFile&) = delete;
+		MappedPaxosFile(MappedPaxosFile&& o) { *this = std::move(o); }
+		MappedPaxosFile& operator=(const MappedPaxosFile&) = delete;
+		MappedPaxosFile& operator=(MappedPaxosFile&& o);
+
+		MappedPaxosFile(const std::string& path) { open(path); }
+
+		~MappedPaxosFile() { close(); }
+
+		// map the file at path. Throws if it is not a valid encoding.
+		void open(const std::string& path);
+
+		// unmap the file. Any span returned by p() becomes invalid.
+		void close();
+
+		bool isOpen() const { return mData != nullptr; }
+
+		const PaxosFileHeader& header() const { return mHeader; }
+
+		// initialize baxos with the parameters of the file so that
+		// it can decode p().
+		void init(Baxos& baxos) const;
+
+		// initialize paxos with the parameters of the file so that
+		// it can decode p().
+		template<typename IdxType>
+		void init(Paxos<IdxType>& paxos) const;
+
+		// the paxos vector. ValueType must be the row type of the file.
+		template<typename ValueType>
+		span<const ValueType> p() const
+		{
+			if (mHeader.mRowBytes != sizeof(ValueType))
+				throw std::runtime_error("the value type does not match the encoding's row size. " LOCATION);
+			return span<const ValueType>((const ValueType*)(mData + mHeader.mDataOffset), mHeader.mNumRows);
+		}
+
+		// the paxos matrix, the number of columns follows from the row size.
+		template<typename ValueType>
+		MatrixView<const ValueType> pMatrix() const
+		{
+			if (mHeader.mRowBytes % sizeof(ValueType))
+				throw std::runtime_error("the value type does not match the encoding's row size. " LOCATION);
+			return MatrixView<const ValueType>(
+				(const ValueType*)(mData + mHeader.mDataOffset),
+				mHeader.mNumRows,
+				mHeader.mRowBytes / sizeof(ValueType));
+		}
+
+	private:
+		PaxosFileHeader mHeader;
+		const u8* mData = nullptr;
+
+		// the bin retries, if the file has them.
+		const u8* binRetries() const { return mData + mHeader.mDataOffset + mHeader.mNumRows * mHeader.mRowBytes; }
+
+		u64 mSize = 0;
+	};
+
+	namespace details
+	{
+		// write the header followed by p and, if the header has them, the
+		// bin retries to path.
+		void writePaxosFile(const std::string& path, PaxosFileHeader& header, const u8* p, const u8* binRetries = nullptr);
+
+		// set the data offset of the header and write it followed by the
+		// padding up to the data. p should be written next.
+		void writePaxosFileHeader(std::ostream& out, PaxosFileHeader& header);
+	}
+
+	template<typename IdxType>
+	void writePaxosFile(const std::string& path, const Paxos<IdxType>& paxos, const u8* p, u64 numRows, u64 rowBytes)
+	{
+		if (numRows != paxos.size())
+			throw RTE_LOC;
+
+		PaxosFileHeader header;
+		header.mKind = PaxosFileHeader::PaxosKind;
+		header.mDenseType = static_cast<u8>(paxos.mDt);
+		header.mIdxBytes = sizeof(IdxType);
+		header.mRowBytes = static_cast<u32>(rowBytes);
+		header.mNumItems = paxos.mNumItems;
+		header.mNumBins = 1;
+		header.mItemsPerBin = paxos.mNumItems;
+		header.mWeight = paxos.mWeight;
+		header.mSsp = paxos.mSsp;
+		header.mSparseSize = paxos.mSparseSize;
+		header.mDenseSize = paxos.mDenseSize;
+		header.mG = paxos.mG;
+		header.mSeed = { paxos.mSeed.template get<u64>(0), paxos.mSeed.template get<u64>(1) };
+		header.mNumRows = numRows;
+		details::writePaxosFile(path, header, p);
+	}
+
+	template<typename IdxType>
+	void MappedPaxosFile::init(Paxos<IdxType>& paxos) const
+	{
+		if (mHeader.mKind != PaxosFileHeader::PaxosKind)
+			throw std::runtime_error("the file does not hold a Paxos encoding. " LOCATION);
+		if (mHeader.mIdxBytes != sizeof(IdxType))
+			throw std::runtime_error("the index type does not match the encoding. " LOCATION);
+
+		paxos.init(mHeader.mNumItems, mHeader.paxosParam(), block(mHeader.mSeed[1], mHeader.mSeed[0]));
+	}
+}
@@ -10,6 +10,8 @@
 #include "SimpleIndex.h"
 #include <immintrin.h>
 #include <future>
+#include <atomic>
+#include <bitset>
 
 namespace volePSI
 {
@@ -721,6 +723,13 @@ namespace volePSI
 			iter += sizeof(T) * rows * cols;
 			return ret;
 		}
+
+		// call routine(thrdIdx) on numThreads threads and wait for them to finish.
+		template<typename Routine>
+		void runThreads(u64 numThreads, Routine&& routine)
+		{
+			threadPool()->run(numThreads, routine);
+		}
 	}
 
 
@@ -736,8 +745,8 @@ namespace volePSI
 
 		if (mAllocationSize < size)
 		{
-			mAllocation = {};
-			mAllocation.reset(new u8[size]);
+			mAllocation.reset(size);
+			mAllocationSize = size;
 		}
 
 		auto iter = mAllocation.get();
@@ -751,6 +760,22 @@ namespace volePSI
 
 	constexpr u8 gPaxosBuildRowSize = 32;
 
+	// the minimum number of items before triangulate(...) will 
+	// peel in parallel.
+	constexpr u64 gPaxosParPeelMinSize = 1 << 14;
+
+	// once fewer than this many columns (per thread) have weight 
+	// one, the parallel peeling hands off to the serial algorithm.
+	constexpr u64 gPaxosParPeelMinFrontier = 1 << 8;
+
+	// the minimum number of items before the rows are hashed and
+	// the columns are built in parallel.
+	constexpr u64 gPaxosParInputMinSize = 1 << 14;
+
+	// the minimum number of gap rows per thread before F C^-1 is 
+	// computed in parallel.
+	constexpr u64 gPaxosParGapMinSize = 4;
+
 	template<typename IdxType>
 	void Paxos<IdxType>::init(u64 numItems, PaxosParam p, block seed)
 	{
@@ -778,10 +803,6 @@ namespace volePSI
 		if (inputs.size() != mNumItems)
 			throw RTE_LOC;
 
-		allocate();
-
-		std::vector<IdxType> colWeights(mSparseSize);
-
 #ifndef NDEBUG
 		{
 			std::unordered_set<block> inputSet;
@@ -789,53 +810,147 @@ namespace volePSI
 			{
 				assert(inputSet.insert(i).second);
 			}
-	}
+		}
 #endif
+
+		beginInput(inputs.size());
 		setTimePoint("setInput alloc");
 
+		addInputs(inputs);
+		setTimePoint("setInput buildRow");
 
-		{
-			auto main = inputs.size() / gPaxosBuildRowSize * gPaxosBuildRowSize;
-			auto inIter = inputs.data();
+		finishInput();
+		setTimePoint("setInput end");
+	}
 
-			for (u64 i = 0; i < main; i += gPaxosBuildRowSize, inIter += gPaxosBuildRowSize)
+	template<typename IdxType>
+	void Paxos<IdxType>::beginInput(u64 n)
+	{
+		if (n > mSparseSize + mDenseSize)
+			throw RTE_LOC;
+
+		mNumItems = static_cast<IdxType>(n);
+		allocate();
+
+		mInputColWeights.assign(mSparseSize, 0);
+		mInputPos = 0;
+	}
+
+	template<typename IdxType>
+	void Paxos<IdxType>::addInputs(span<const block> inputs)
+	{
+		if (mInputColWeights.size() != mSparseSize)
+			throw std::runtime_error("beginInput(...) must be called before addInputs(...). " LOCATION);
+		if (mInputPos + inputs.size() > mNumItems)
+			throw RTE_LOC;
+
+		auto& colWeights = mInputColWeights;
+		if (mNumThreads > 1 && inputs.size() >= gPaxosParInputMinSize)
+		{
+			// each thread hashes a range of the inputs. The columns 
+			// are then counted by countColumns(...).
+			auto begin = mInputPos;
+			auto n = inputs.size();
+			runThreads(mNumThreads, [&](u64 thrdIdx)
 			{
-				auto rr = mRows[i].data();
+				auto b = n * thrdIdx / mNumThreads / gPaxosBuildRowSize * gPaxosBuildRowSize;
+				auto e = thrdIdx + 1 == mNumThreads ? n :
+					n * (thrdIdx + 1) / mNumThreads / gPaxosBuildRowSize * gPaxosBuildRowSize;
+
+				auto i = b;
+				for (; i + gPaxosBuildRowSize <= e; i += gPaxosBuildRowSize)
+					mHasher.hashBuildRow32(&inputs[i], mRows[begin + i].data(), &mDense[begin + i]);
+				for (; i < e; ++i)
+					mHasher.hashBuildRow1(&inputs[i], mRows[begin + i].data(), &mDense[begin + i]);
+			});
+
+			countColumns(MatrixView<const IdxType>(mRows[begin].data(), n, mWeight), colWeights);
+			mInputPos = begin + n;
+			return;
+		}
 
-				//if (gPaxosBuildRowSize == 8)
-				//	mHasher.hashBuildRow8(inIter, rr, &mDense[i]);
-				//else 
-				if (gPaxosBuildRowSize == 32)
-					mHasher.hashBuildRow32(inIter, rr, &mDense[i]);
-				else
-					throw RTE_LOC;
+		auto main = inputs.size() / gPaxosBuildRowSize * gPaxosBuildRowSize;
+		auto inIter = inputs.data();
+		auto i = mInputPos;
 
-				span<IdxType> cols(rr, gPaxosBuildRowSize * mWeight);
-				for (auto c : cols)
-				{
-					++colWeights[c];
-				}
+		for (auto end = mInputPos + main; i < end; i += gPaxosBuildRowSize, inIter += gPaxosBuildRowSize)
+		{
+			auto rr = mRows[i].data();
+
+			//if (gPaxosBuildRowSize == 8)
+			//	mHasher.hashBuildRow8(inIter, rr, &mDense[i]);
+			//else 
+			if (gPaxosBuildRowSize == 32)
+				mHasher.hashBuildRow32(inIter, rr, &mDense[i]);
+			else
+				throw RTE_LOC;
+
+			span<IdxType> cols(rr, gPaxosBuildRowSize * mWeight);
+			for (auto c : cols)
+			{
+				++colWeights[c];
 			}
+		}
 
-			for (u64 i = main; i < mNumItems; ++i, ++inIter)
+		for (auto end = mInputPos + inputs.size(); i < end; ++i, ++inIter)
+		{
+			mHasher.hashBuildRow1(inIter, mRows[i].data(), &mDense[i]);
+			for (auto c : mRows[i])
 			{
-				mHasher.hashBuildRow1(inIter, mRows[i].data(), &mDense[i]);
-				for (auto c : mRows[i])
-				{
-					++colWeights[c];
-				}
+				++colWeights[c];
 			}
 		}
-		setTimePoint("setInput buildRow");
 
-		rebuildColumns(colWeights, mWeight * mNumItems);
-		setTimePoint("setInput rebuildColumns");
+		mInputPos = i;
+	}
 
-		mWeightSets.init(colWeights);
+	template<typename IdxType>
+	void Paxos<IdxType>::addHashes(span<const block> hashes)
+	{
+		static constexpr const u64 batchSize = 32;
+		if (mInputColWeights.size() != mSparseSize)
+			throw std::runtime_error("beginInput(...) must be called before addHashes(...). " LOCATION);
+		if (mInputPos + hashes.size() > mNumItems)
+			throw RTE_LOC;
+		if (hashes.size() == 0)
+			return;
 
-		setTimePoint("setInput end");
+		u64 i = 0;
+		for (; i + batchSize <= hashes.size(); i += batchSize)
+			mHasher.buildRow32(&hashes[i], mRows[mInputPos + i].data());
+		for (; i < hashes.size(); ++i)
+			mHasher.buildRow(hashes[i], mRows[mInputPos + i].data());
 
-}
+		std::copy(hashes.begin(), hashes.end(), mDense.begin() + mInputPos);
+		for (auto c : span<IdxType>(mRows[mInputPos].data(), hashes.size() * mWeight))
+			++mInputColWeights[c];
+
+		mInputPos += hashes.size();
+	}
+
+	template<typename IdxType>
+	void Paxos<IdxType>::finishInput()
+	{
+		if (mInputColWeights.size() != mSparseSize)
+			throw std::runtime_error("beginInput(...) must be called before finishInput(...). " LOCATION);
+
+		// fewer keys than reserved may have been added.
+		if (mInputPos != mNumItems)
+		{
+			mNumItems = static_cast<IdxType>(mInputPos);
+			mDense = mDense.subspan(0, mNumItems);
+			mRows = MatrixView<IdxType>(mRows.data(), mNumItems, mWeight);
+			mColBacking = mColBacking.subspan(0, mNumItems * mWeight);
+		}
+
+		rebuildColumns(mInputColWeights, mWeight * mNumItems);
+		setTimePoint("setInput rebuildColumns");
+
+		mWeightSets.init(mInputColWeights);
+
+		mInputColWeights = {};
+		mInputPos = 0;
+	}
 
 
 	template<typename IdxType>
@@ -1087,8 +1202,13 @@ namespace volePSI
 	{
 		setTimePoint("triangulate begin");
 
+		std::vector<u8> rowSet(mNumItems);
 
-		if (mWeightSets.mWeightSets.size() <= 1)
+		if (mNumThreads > 1 && mNumItems >= gPaxosParPeelMinSize)
+		{
+			parallelPeel(mainRows, mainCols, rowSet);
+		}
+		else if (mWeightSets.mWeightSets.size() <= 1)
 		{
 			std::vector<IdxType> colWeights(mSparseSize);
 			for (u64 i = 0; i < mCols.size(); ++i)
@@ -1098,7 +1218,6 @@ namespace volePSI
 			mWeightSets.init(colWeights);
 		}
 
-		std::vector<u8> rowSet(mNumItems);
 		while (mWeightSets.mWeightSets.size() > 1)
 		{
 			auto& col = mWeightSets.getMinWeightNode();
@@ -1175,6 +1294,173 @@ namespace volePSI
 
 	}
 
+	template<typename IdxType>
+	void Paxos<IdxType>::parallelPeel(
+		std::vector<IdxType>& mainRows,
+		std::vector<IdxType>& mainCols,
+		std::vector<u8>& rowSet)
+	{
+		// We repeatedly peel all the columns which currently have weight one.
+		// A weight one column c has a single unfixed row r. The thread that
+		// fixes r (via compare-exchange) assigns it to c. Two weight one columns
+		// can share their row, then only one wins it and the other drops to weight
+		// zero, so each row is assigned to at most one column. At the start of the
+		// round r is the only unfixed row of c, so c contains none of the rows that
+		// the other columns of the round are assigned. Therefore the order
+		// within a round does not matter for backfill(...). Columns whose weight
+		// drops to one are processed in the next round. Once the number of weight 
+		// one columns becomes small, the remaining columns are handed to the 
+		// serial algorithm via mWeightSets.
+
+		auto numThreads = std::max<u64>(1, mNumThreads);
+		auto numCols = mSparseSize;
+
+		std::unique_ptr<std::atomic<IdxType>[]> colWeights(new std::atomic<IdxType>[numCols]);
+		std::unique_ptr<std::atomic<u8>[]> rowFixed(new std::atomic<u8>[mNumItems]);
+
+		struct ThrdState
+		{
+			// the weight one columns this thread found in the 
+			// previous round and the current round.
+			std::vector<IdxType> mCur, mNext;
+
+			// the column, row pairs that this thread peeled
+			// in the current round.
+			std::vector<std::array<IdxType, 2>> mPeeled;
+
+			// where mPeeled should be written in mainRows/mainCols.
+			u64 mOffset = 0;
+		};
+
+		std::vector<ThrdState> state(numThreads);
+		ThreadBarrier barrier(numThreads);
+		bool done = false;
+		std::vector<IdxType> weights(numCols);
+
+		// try to peel column c. This succeeds if this thread
+		// is the one to fix the last remaining row of c.
+		auto tryPeel = [&](IdxType c, ThrdState& s)
+		{
+			if (colWeights[c].load(std::memory_order_relaxed) != 1)
+				return;
+
+			for (auto r : mCols[c])
+			{
+				if (rowFixed[r].load(std::memory_order_relaxed) == 0)
+				{
+					u8 expected = 0;
+					if (rowFixed[r].compare_exchange_strong(expected, 1))
+					{
+						s.mPeeled.push_back({ c, r });
+
+						for (auto c2 : mRows[r])
+						{
+							if (colWeights[c2].fetch_sub(1) == 2)
+								s.mNext.push_back(c2);
+						}
+					}
+					return;
+				}
+			}
+		};
+
+		auto routine = [&](u64 thrdIdx)
+		{
+			auto& s = state[thrdIdx];
+
+			{
+				auto begin = numCols * thrdIdx / numThreads;
+				auto end = numCols * (thrdIdx + 1) / numThreads;
+				for (auto i = begin; i < end; ++i)
+				{
+					auto w = static_cast<IdxType>(mCols[i].size());
+					colWeights[i].store(w, std::memory_order_relaxed);
+					if (w == 1)
+						s.mNext.push_back(static_cast<IdxType>(i));
+				}
+
+				begin = mNumItems * thrdIdx / numThreads;
+				end = mNumItems * (thrdIdx + 1) / numThreads;
+				for (auto i = begin; i < end; ++i)
+					rowFixed[i].store(0, std::memory_order_relaxed);
+			}
+
+			while (true)
+			{
+				barrier.wait();
+
+				if (thrdIdx == 0)
+				{
+					// merge the results of the last round and
+					// set up the next one.
+					u64 total = 0;
+					auto size = mainRows.size();
+					for (auto& ss : state)
+					{
+						ss.mOffset = size;
+						size += ss.mPeeled.size();
+						std::swap(ss.mCur, ss.mNext);
+						ss.mNext.clear();
+						total += ss.mCur.size();
+					}
+					mainRows.resize(size);
+					mainCols.resize(size);
+
+					done = total < gPaxosParPeelMinFrontier * numThreads;
+				}
+
+				barrier.wait();
+
+				for (u64 i = 0; i < s.mPeeled.size(); ++i)
+				{
+					mainCols[s.mOffset + i] = s.mPeeled[i][0];
+					mainRows[s.mOffset + i] = s.mPeeled[i][1];
+				}
+				s.mPeeled.clear();
+
+				if (done)
+					break;
+
+				// peel this threads share of the weight one columns.
+				u64 total = 0;
+				for (auto& ss : state)
+					total += ss.mCur.size();
+
+				auto begin = total * thrdIdx / numThreads;
+				auto end = total * (thrdIdx + 1) / numThreads;
+				u64 pos = 0;
+				for (auto& ss : state)
+				{
+					auto b = std::max<u64>(begin, pos);
+					auto e = std::min<u64>(end, pos + ss.mCur.size());
+					for (auto i = b; i < e; ++i)
+						tryPeel(ss.mCur[i - pos], s);
+					pos += ss.mCur.size();
+				}
+			}
+
+			auto begin = numCols * thrdIdx / numThreads;
+			auto end = numCols * (thrdIdx + 1) / numThreads;
+			for (auto i = begin; i < end; ++i)
+				weights[i] = colWeights[i].load(std::memory_order_relaxed);
+
+			begin = mNumItems * thrdIdx / numThreads;
+			end = mNumItems * (thrdIdx + 1) / numThreads;
+			for (auto i = begin; i < end; ++i)
+				rowSet[i] = rowFixed[i].load(std::memory_order_relaxed);
+		};
+
+		threadPool()->run(numThreads, barrier.abortOnThrow(routine));
+
+		setTimePoint("triangulate parallelPeel");
+
+		// the remaining columns are given to the serial algorithm. The 
+		// peeled columns have been fixed and therefore are removed. 
+		mWeightSets.init(weights);
+		for (auto c : mainCols)
+			mWeightSets.popNode(mWeightSets.mNodes[c]);
+	}
+
 	template<typename IdxType>
 	template<typename Vec, typename ConstVec, typename Helper>
 	void Paxos<IdxType>::encode(ConstVec& values, Vec& output, Helper& h, PRNG* prng)
@@ -1182,39 +1468,93 @@ namespace volePSI
 		if (static_cast<u64>(output.size()) != size())
 			throw RTE_LOC;
 
-		std::vector<IdxType> mainRows, mainCols;
-		mainRows.reserve(mNumItems); mainCols.reserve(mNumItems);
-		std::vector<std::array<IdxType, 2>> gapRows;
+		auto plan = getPlan();
+		encode(plan, values, output, h, prng);
+	}
 
-		triangulate(mainRows, mainCols, gapRows);
+	template<typename IdxType>
+	PaxosPlan<IdxType> Paxos<IdxType>::getPlan()
+	{
+		PaxosPlan<IdxType> plan;
+		plan.mNumItems = mNumItems;
+		plan.mMainRows.reserve(mNumItems); plan.mMainCols.reserve(mNumItems);
 
-		output.zerofill();
+		triangulate(plan.mMainRows, plan.mMainCols, plan.mGapRows);
 
-		if (prng)
+		typename WeightData<IdxType>::WeightNode* node = mWeightSets.mWeightSets[0];
+		while (node != nullptr)
+		{
+			plan.mFreeCols.push_back(static_cast<IdxType>(mWeightSets.idxOf(*node)));
+
+			if (node->mNextWeightNode == mWeightSets.NullNode)
+				node = nullptr;
+			else
+				node = mWeightSets.mNodes.data() + node->mNextWeightNode;
+		}
+
+		auto g = plan.mGapRows.size();
+		if (g)
 		{
-			typename WeightData<IdxType>::WeightNode* node = mWeightSets.mWeightSets[0];
-			while (node != nullptr)
+			plan.mFCInv = getFCInv(plan.mMainRows, plan.mMainCols, plan.mGapRows);
+
+			if (mDt == DenseType::GF128)
 			{
-				auto colIdx = mWeightSets.idxOf(*node);
-				//prng->get(output[colIdx], output.stride());
-				h.randomize(output[colIdx], *prng);
+				if (g > mDenseSize)
+					throw PaxosSolveError("the paxos gap is larger than the dense part. " LOCATION);
 
-				if (node->mNextWeightNode == mWeightSets.NullNode)
-					node = nullptr;
-				else
-					node = mWeightSets.mNodes.data() + node->mNextWeightNode;
+				plan.mEE = getEPrimeGf128(plan.mFCInv, plan.mGapRows);
+
+				// the non-randomized encoding only uses the first g columns.
+				Matrix<block> EE(g, g);
+				for (u64 i = 0; i < g; ++i)
+					for (u64 j = 0; j < g; ++j)
+						EE(i, j) = plan.mEE(i, j);
+				plan.mEEInv = gf128Inv(EE);
 			}
+			else
+			{
+				if (g > mG)
+					throw PaxosSolveError("the paxos gap is larger than the dense part. " LOCATION);
+
+				// get the columns for the gap which define
+				// B, E and therefore EE.
+				plan.mGapCols = getGapCols(plan.mFCInv, plan.mGapRows);
+
+				// E' = E - FC^-1 B 
+				plan.mBinEEInv = getEPrime(plan.mFCInv, plan.mGapRows, plan.mGapCols).invert();
+			}
+		}
+
+		setTimePoint("getPlan");
+		return plan;
+	}
+
+	template<typename IdxType>
+	template<typename Vec, typename ConstVec, typename Helper>
+	void Paxos<IdxType>::encode(const PaxosPlan<IdxType>& plan, ConstVec& values, Vec& output, Helper& h, PRNG* prng)
+	{
+		if (static_cast<u64>(output.size()) != size())
+			throw RTE_LOC;
+		if (plan.mNumItems != mNumItems || static_cast<u64>(values.size()) != mNumItems)
+			throw RTE_LOC;
+
+		output.zerofill();
+
+		if (prng)
+		{
+			for (auto colIdx : plan.mFreeCols)
+				h.randomize(output[colIdx], *prng);
 		}
 
-		backfill(mainRows, mainCols, gapRows, values, output, h, prng);
+		backfill(plan, values, output, h, prng);
 	}
 
 	template<typename IdxType>
 	template<typename Vec, typename ConstVec, typename Helper>
 	Vec Paxos<IdxType>::getX2Prime(
-		FCInv& fcinv,
-		span<std::array<IdxType, 2>> gapRows,
-		span<u64> gapCols,
+		const FCInv& fcinv,
+		span<const std::array<IdxType, 2>> gapRows,
+		span<const u64> gapCols,
 		const ConstVec& X,
 		const Vec& P,
 		Helper& helper)
@@ -1267,9 +1607,9 @@ namespace volePSI
 
 	template<typename IdxType>
 	oc::DenseMtx Paxos<IdxType>::getEPrime(
-		FCInv& fcinv,
-		span<std::array<IdxType, 2>> gapRows,
-		span<u64> gapCols)
+		const FCInv& fcinv,
+		span<const std::array<IdxType, 2>> gapRows,
+		span<const u64> gapCols)
 	{
 		auto g = gapRows.size();
 
@@ -1294,9 +1634,50 @@ namespace volePSI
 		return EE;
 	}
 
+	template<typename IdxType>
+	Matrix<block> Paxos<IdxType>::getEPrimeGf128(
+		const FCInv& fcinv,
+		span<const std::array<IdxType, 2>> gapRows)
+	{
+		auto g = gapRows.size();
+
+		//      |dense[r0]^1, dense[r0]^2, ... |
+		// E =  |dense[r1]^1, dense[r1]^2, ... |
+		//      |dense[r2]^1, dense[r2]^2, ... |
+		//      ...
+		// EE = E - FC^-1 B
+		Matrix<block> EE(g, mDenseSize);
+
+		for (u64 i = 0; i < g; ++i)
+		{
+			block e = mDense[gapRows[i][0]];
+			block ej = e;
+			EE(i, 0) = e;
+			for (u64 j = 1; j < mDenseSize; ++j)
+			{
+				ej = ej.gf128Mul(e);
+				EE(i, j) = ej;
+			}
+
+			for (auto j : fcinv.mMtx[i])
+			{
+				auto fcb = mDense[j];
+				auto fcbk = fcb;
+				EE(i, 0) = EE(i, 0) ^ fcbk;
+				for (u64 k = 1; k < mDenseSize; ++k)
+				{
+					fcbk = fcbk.gf128Mul(fcb);
+					EE(i, k) = EE(i, k) ^ fcbk;
+				}
+			}
+		}
+
+		return EE;
+	}
+
 	template<typename IdxType>
 	template<typename Vec, typename Helper>
-	void Paxos<IdxType>::randomizeDenseCols(Vec& p2, Helper& h, span<u64> gapCols, PRNG* prng)
+	void Paxos<IdxType>::randomizeDenseCols(Vec& p2, Helper& h, span<const u64> gapCols, PRNG* prng)
 	{
 		assert(prng);
 
@@ -1317,9 +1698,7 @@ namespace volePSI
 	template<typename IdxType>
 	template<typename Vec, typename ConstVec, typename Helper>
 	void Paxos<IdxType>::backfill(
-		span<IdxType> mainRows,
-		span<IdxType> mainCols,
-		span<std::array<IdxType, 2>> gapRows,
+		const PaxosPlan<IdxType>& plan,
 		ConstVec& X,
 		Vec& P,
 		Helper& h,
@@ -1405,29 +1784,30 @@ namespace volePSI
 		// Both perform the same basic algorithm,
 		if (mDt == DenseType::GF128)
 		{
-			backfillGf128(mainRows, mainCols, gapRows, X, P, h, prng);
+			backfillGf128(plan, X, P, h, prng);
 		}
 		else
 		{
-			backfillBinary(mainRows, mainCols, gapRows, X, P, h, prng);
+			backfillBinary(plan, X, P, h, prng);
 		}
 	}
 
 	template<typename IdxType>
 	template<typename Vec, typename ConstVec, typename Helper>
 	void Paxos<IdxType>::backfillBinary(
-		span<IdxType> mainRows,
-		span<IdxType> mainCols,
-		span<std::array<IdxType, 2>> gapRows,
+		const PaxosPlan<IdxType>& plan,
 		ConstVec& X,
 		Vec& P,
 		Helper& h,
 		oc::PRNG* prng)
 	{
+		auto& mainRows = plan.mMainRows;
+		auto& mainCols = plan.mMainCols;
+		auto& gapRows = plan.mGapRows;
 		auto g = gapRows.size();
 
 		// the dense columns which index the gap.
-		std::vector<u64> gapCols;
+		span<const u64> gapCols = plan.mGapCols;
 
 		// masks that will be used to select the 
 		// bits of the dense columns.
@@ -1437,27 +1817,19 @@ namespace volePSI
 		auto p2 = P.subspan(mSparseSize);
 
 		if (g > mG)
-			throw RTE_LOC;
+			throw PaxosSolveError("the paxos gap is larger than the dense part. " LOCATION);
 
 		if (g)
 		{
-
-			auto fcinv = getFCInv(mainRows, mainCols, gapRows);
-
-			// get the columns for the gap which define
-			// B, E and therefore EE.
-			gapCols = getGapCols(fcinv, gapRows);
-
 			if (prng)
 				randomizeDenseCols(p2, h, gapCols, prng);
 
 			//auto PP = 
 			// x2' = x2 - D r - FC^-1 x1
-			auto xx2 = getX2Prime(fcinv, gapRows, gapCols, X, prng ? P : Vec{}, h);
+			auto xx2 = getX2Prime(plan.mFCInv, gapRows, gapCols, X, prng ? P : Vec{}, h);
 
-			// E' = E - FC^-1 B 
-			DenseMtx EE = getEPrime(fcinv, gapRows, gapCols);
-			auto EEInv = EE.invert();
+			// E'^-1 = (E - FC^-1 B)^-1
+			auto& EEInv = plan.mBinEEInv;
 
 			// now we compute
 			// p2 = E'^-1            * x2'
@@ -1552,77 +1924,60 @@ namespace volePSI
 	template<typename IdxType>
 	template<typename Vec, typename ConstVec, typename Helper>
 	void Paxos<IdxType>::backfillGf128(
-		span<IdxType> mainRows,
-		span<IdxType> mainCols,
-		span<std::array<IdxType, 2>> gapRows,
+		const PaxosPlan<IdxType>& plan,
 		ConstVec& X,
 		Vec& P,
 		Helper& helper,
 		PRNG* prng)
 	{
 		assert(mDt == DenseType::GF128);
+		auto& mainRows = plan.mMainRows;
+		auto& mainCols = plan.mMainCols;
+		auto& gapRows = plan.mGapRows;
 		auto g = gapRows.size();
 		auto p2 = P.subspan(mSparseSize);
 
 		if (g > mDenseSize)
-			throw RTE_LOC;
+			throw PaxosSolveError("the paxos gap is larger than the dense part. " LOCATION);
 
 		if (g)
 		{
-			auto fcinv = getFCInv(mainRows, mainCols, gapRows);
+			auto& fcinv = plan.mFCInv;
 			auto size = prng ? mDenseSize : g;
 
-			//      |dense[r0]^1, dense[r0]^2, ... |
-			// E =  |dense[r1]^1, dense[r1]^2, ... |
-			//      |dense[r2]^1, dense[r2]^2, ... |
-			//      ...
-			// EE = E - FC^-1 B
-			Matrix<block> EE(size, size);
-
 			// xx = x' - FC^-1 x
 			Vec xx = helper.newVec(size);
-			//std::vector<block> xx(size);
-			std::vector<block> fcb(size);
 
 			for (u64 i = 0; i < g; ++i)
 			{
-				block e = mDense[gapRows[i][0]];
-				block ej = e;
-				EE(i, 0) = e;//^ fcb;
-				for (u64 j = 1; j < size; ++j)
-				{
-					ej = ej.gf128Mul(e);
-					EE(i, j) = ej;
-				}
-
-
 				helper.assign(xx[i], X[gapRows[i][0]]);
 				for (auto j : fcinv.mMtx[i])
-				{
 					helper.add(xx[i], X[j]);
-					auto fcb = mDense[j];
-					auto fcbk = fcb;
-					EE(i, 0) = EE(i, 0) ^ fcbk;
-					for (u64 k = 1; k < size; ++k)
-					{
-						fcbk = fcbk.gf128Mul(fcb);
-						EE(i, k) = EE(i, k) ^ fcbk;
-					}
-				}
 			}
 
+			// the non-randomized inverse only depends on the keys
+			// and is part of the plan. Otherwise EE is padded with 
+			// random rows and has to be inverted each time.
+			Matrix<block> EERand;
 			if (prng)
 			{
+				// EE = E - FC^-1 B
+				EERand.resize(size, size);
+				for (u64 i = 0; i < g; ++i)
+					std::copy(plan.mEE[i].begin(), plan.mEE[i].end(), EERand[i].begin());
+
 				for (u64 i = g; i < mDenseSize; ++i)
 				{
-					prng->get<block>(EE[i]);
+					prng->get<block>(EERand[i]);
 					helper.randomize(xx[i], *prng);
 				}
+
+				EERand = gf128Inv(EERand);
 			}
 
-			EE = gf128Inv(EE);
+			auto& EE = prng ? EERand : plan.mEEInv;
 			if (EE.size() == 0)
-				throw std::runtime_error("E' not invertable. " LOCATION);
+				throw PaxosSolveError("E' not invertable. " LOCATION);
 
 			// now we compute
 			// p' = (E - FC^-1 B)^-1 * (x'-FC^-1 x)
@@ -1645,7 +2000,7 @@ namespace volePSI
 
 		auto outColIter = mainCols.rbegin();
 		auto rowIter = mainRows.rbegin();
-		bool doDense = g || prng;
+		bool doDense = (g || prng) && mDenseSize;
 
 #define GF128_DENSE_BACKFILL										\
         if(doDense){														\
@@ -1733,32 +2088,350 @@ namespace volePSI
 	}
 
 
-	template<typename IdxType>
-	template<typename ValueType, typename Helper, typename Vec>
-	void Paxos<IdxType>::decode32(
-		const IdxType* rows_,
-		const block* dense_,
-		ValueType* values_,
-		Vec& p_,
-		Helper& h)
+#if defined(ENABLE_SSE) && (defined(__GNUC__) || defined(__clang__))
+#define PAXOS_SIMD_DECODE
+#define PAXOS_TARGET_AVX2 __attribute__((target("avx2,pclmul")))
+#define PAXOS_TARGET_AVX512 __attribute__((target("avx2,pclmul,avx512f,avx512bw,vpclmulqdq")))
+
+	// reduce the 256 bit carry-less product hi||lo modulo x^128 + x^7 + x^2 + x + 1.
+	// Same as block::gf128Reduce.
+	PAXOS_TARGET_AVX2 inline __m128i paxosGf128Reduce(__m128i lo, __m128i hi)
 	{
-		//{
-		//	auto r = rows_;
-		//	auto d = dense_;
-		//	auto v = values_;
-		//	auto& p = p_;
+		const __m128i modulus = _mm_set_epi64x(0, 0b10000111);
+		__m128i tmp = _mm_clmulepi64_si128(hi, modulus, 0x01);
+		lo = _mm_xor_si128(lo, _mm_slli_si128(tmp, 8));
+		hi = _mm_xor_si128(hi, _mm_srli_si128(tmp, 8));
+		tmp = _mm_clmulepi64_si128(hi, modulus, 0x00);
+		return _mm_xor_si128(lo, tmp);
+	}
 
-		//	for (u64 j = 0; j < 4; ++j)
-		//	{
-		//		decode8(r, d, v, p, h);
-		//		r += 8 * mWeight;
-		//		d += 8;
-		//		v = h.iterPlus(v, 8);
-		//	}
-		//	return;
-		//}
+	// x * y in gf128. Same as block::gf128Mul.
+	PAXOS_TARGET_AVX2 inline __m128i paxosGf128Mul(__m128i x, __m128i y)
+	{
+		__m128i t1 = _mm_clmulepi64_si128(x, y, 0x00);
+		__m128i t4 = _mm_clmulepi64_si128(x, y, 0x11);
+		__m128i tm = _mm_xor_si128(
+			_mm_clmulepi64_si128(x, y, 0x01),
+			_mm_clmulepi64_si128(x, y, 0x10));
+		return paxosGf128Reduce(
+			_mm_xor_si128(t1, _mm_slli_si128(tm, 8)),
+			_mm_xor_si128(t4, _mm_srli_si128(tm, 8)));
+	}
 
-		const ValueType* __restrict p = p_[0];
+	// the 512 bit version of paxosGf128Reduce, four independent lanes.
+	PAXOS_TARGET_AVX512 inline __m512i paxosGf128Reduce(__m512i lo, __m512i hi)
+	{
+		const __m512i modulus = _mm512_broadcast_i32x4(_mm_set_epi64x(0, 0b10000111));
+		__m512i tmp = _mm512_clmulepi64_epi128(hi, modulus, 0x01);
+		lo = _mm512_xor_si512(lo, _mm512_bslli_epi128(tmp, 8));
+		hi = _mm512_xor_si512(hi, _mm512_bsrli_epi128(tmp, 8));
+		tmp = _mm512_clmulepi64_epi128(hi, modulus, 0x00);
+		return _mm512_xor_si512(lo, tmp);
+	}
+
+	// the 512 bit version of paxosGf128Mul, four independent lanes.
+	PAXOS_TARGET_AVX512 inline __m512i paxosGf128Mul(__m512i x, __m512i y)
+	{
+		__m512i t1 = _mm512_clmulepi64_epi128(x, y, 0x00);
+		__m512i t4 = _mm512_clmulepi64_epi128(x, y, 0x11);
+		__m512i tm = _mm512_xor_si512(
+			_mm512_clmulepi64_epi128(x, y, 0x01),
+			_mm512_clmulepi64_epi128(x, y, 0x10));
+		return paxosGf128Reduce(
+			_mm512_xor_si512(t1, _mm512_bslli_epi128(tm, 8)),
+			_mm512_xor_si512(t4, _mm512_bsrli_epi128(tm, 8)));
+	}
+
+	// values[i] += sum_j p2[j] * dense[i]_j for the i < 8 rows of 
+	// the binary dense part. Only the set bits are visited.
+	PAXOS_TARGET_AVX2 inline void paxosDecodeBinaryDense8(
+		const block* dense, block* values, const block* p2, u64 denseSize)
+	{
+		assert(denseSize <= 64);
+		auto mask = denseSize == 64 ? ~0ull : (1ull << denseSize) - 1;
+		for (u64 i = 0; i < 8; ++i)
+		{
+			auto d = dense[i].get<u64>(0) & mask;
+			__m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+			while (d)
+			{
+				v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)(p2 + __builtin_ctzll(d))));
+				d &= d - 1;
+			}
+			_mm_storeu_si128((__m128i*)(values + i), v);
+		}
+	}
+
+	// values[i] += sum_j p2[j] * dense[i]^(j+1) for the i < 8 rows of the
+	// gf128 dense part. The products are accumulated without reduction
+	// and only the sum is reduced.
+	PAXOS_TARGET_AVX2 inline void paxosDecodeGf128Dense8(
+		const block* dense, block* values, const block* p2, u64 denseSize)
+	{
+		__m128i d[8], x[8], a0[8], a1[8], am[8];
+		for (u64 i = 0; i < 8; ++i)
+		{
+			d[i] = x[i] = _mm_loadu_si128((const __m128i*)(dense + i));
+			a0[i] = a1[i] = am[i] = _mm_setzero_si128();
+		}
+
+		for (u64 k = 0; k < denseSize; ++k)
+		{
+			__m128i pk = _mm_loadu_si128((const __m128i*)(p2 + k));
+			for (u64 i = 0; i < 8; ++i)
+			{
+				a0[i] = _mm_xor_si128(a0[i], _mm_clmulepi64_si128(pk, x[i], 0x00));
+				a1[i] = _mm_xor_si128(a1[i], _mm_clmulepi64_si128(pk, x[i], 0x11));
+				am[i] = _mm_xor_si128(am[i], _mm_xor_si128(
+					_mm_clmulepi64_si128(pk, x[i], 0x01),
+					_mm_clmulepi64_si128(pk, x[i], 0x10)));
+			}
+
+			if (k + 1 < denseSize)
+				for (u64 i = 0; i < 8; ++i)
+					x[i] = paxosGf128Mul(x[i], d[i]);
+		}
+
+		for (u64 i = 0; i < 8; ++i)
+		{
+			__m128i r = paxosGf128Reduce(
+				_mm_xor_si128(a0[i], _mm_slli_si128(am[i], 8)),
+				_mm_xor_si128(a1[i], _mm_srli_si128(am[i], 8)));
+			__m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+			_mm_storeu_si128((__m128i*)(values + i), _mm_xor_si128(v, r));
+		}
+	}
+
+	// prefetches the p[c] touched by the 8 rows starting at r.
+	template<typename IdxType>
+	inline void paxosPrefetch8(const IdxType* r, const block* p, u64 weight)
+	{
+		for (u64 i = 0; i < 8 * weight; ++i)
+			_mm_prefetch((const char*)(p + r[i]), _MM_HINT_T0);
+	}
+
+	// decodes n block values, n a multiple of 8. The sparse part is 
+	// accumulated two rows per register. See Paxos::decode32.
+	template<typename IdxType>
+	PAXOS_TARGET_AVX2 void paxosDecodeAvx2(
+		const IdxType* rows,
+		const block* dense,
+		block* values,
+		const block* p,
+		u64 n,
+		u64 weight,
+		u64 sparseSize,
+		u64 denseSize,
+		bool gf128)
+	{
+		auto p2 = p + sparseSize;
+
+		for (u64 g = 0; g < n; g += 8)
+		{
+			auto r = rows + g * weight;
+			if (g + 8 < n)
+				paxosPrefetch8(r + 8 * weight, p, weight);
+			__m256i v[4];
+			for (u64 k = 0; k < 4; ++k)
+				v[k] = _mm256_setzero_si256();
+
+			for (u64 j = 0; j < weight; ++j)
+			{
+				for (u64 k = 0; k < 4; ++k)
+				{
+					// two 128 bit loads are cheaper than a 4 x u64 gather.
+					auto p0 = _mm_loadu_si128((const __m128i*)(p + r[(2 * k + 0) * weight + j]));
+					auto p1 = _mm_loadu_si128((const __m128i*)(p + r[(2 * k + 1) * weight + j]));
+					v[k] = _mm256_xor_si256(v[k],
+						_mm256_inserti128_si256(_mm256_castsi128_si256(p0), p1, 1));
+				}
+			}
+
+			for (u64 k = 0; k < 4; ++k)
+				_mm256_storeu_si256((__m256i*)(values + g + 2 * k), v[k]);
+
+			if (gf128)
+			{
+				if (denseSize)
+					paxosDecodeGf128Dense8(dense + g, values + g, p2, denseSize);
+			}
+			else
+				paxosDecodeBinaryDense8(dense + g, values + g, p2, denseSize);
+		}
+	}
+
+	// returns p[c] for the j'th column c of the four rows starting at r.
+	template<typename IdxType>
+	PAXOS_TARGET_AVX512 inline __m512i paxosGather4(const IdxType* r, const block* p, u64 weight, u64 j)
+	{
+		__m512i x = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)(p + r[0 * weight + j])));
+		x = _mm512_inserti32x4(x, _mm_loadu_si128((const __m128i*)(p + r[1 * weight + j])), 1);
+		x = _mm512_inserti32x4(x, _mm_loadu_si128((const __m128i*)(p + r[2 * weight + j])), 2);
+		x = _mm512_inserti32x4(x, _mm_loadu_si128((const __m128i*)(p + r[3 * weight + j])), 3);
+		return x;
+	}
+
+	// decodes n block values, n a multiple of 8. The sparse part is gathered
+	// four rows per register and the gf128 dense part is computed four rows
+	// at a time with VPCLMULQDQ. See Paxos::decode32.
+	template<typename IdxType>
+	PAXOS_TARGET_AVX512 void paxosDecodeAvx512(
+		const IdxType* rows,
+		const block* dense,
+		block* values,
+		const block* p,
+		u64 n,
+		u64 weight,
+		u64 sparseSize,
+		u64 denseSize,
+		bool gf128)
+	{
+		auto p2 = p + sparseSize;
+
+		for (u64 g = 0; g < n; g += 8)
+		{
+			auto r = rows + g * weight;
+			if (g + 8 < n)
+				paxosPrefetch8(r + 8 * weight, p, weight);
+			__m512i v0 = paxosGather4(r, p, weight, 0);
+			__m512i v1 = paxosGather4(r + 4 * weight, p, weight, 0);
+			for (u64 j = 1; j < weight; ++j)
+			{
+				v0 = _mm512_xor_si512(v0, paxosGather4(r, p, weight, j));
+				v1 = _mm512_xor_si512(v1, paxosGather4(r + 4 * weight, p, weight, j));
+			}
+
+			if (gf128 && denseSize)
+			{
+				__m512i d0 = _mm512_loadu_si512((const void*)(dense + g));
+				__m512i d1 = _mm512_loadu_si512((const void*)(dense + g + 4));
+				__m512i x0 = d0, x1 = d1;
+				__m512i a00 = _mm512_setzero_si512(), a01 = a00, a0m = a00;
+				__m512i a10 = a00, a11 = a00, a1m = a00;
+
+				for (u64 k = 0; k < denseSize; ++k)
+				{
+					__m512i pk = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i*)(p2 + k)));
+
+					a00 = _mm512_xor_si512(a00, _mm512_clmulepi64_epi128(pk, x0, 0x00));
+					a01 = _mm512_xor_si512(a01, _mm512_clmulepi64_epi128(pk, x0, 0x11));
+					a0m = _mm512_ternarylogic_epi64(a0m,
+						_mm512_clmulepi64_epi128(pk, x0, 0x01),
+						_mm512_clmulepi64_epi128(pk, x0, 0x10), 0x96);
+
+					a10 = _mm512_xor_si512(a10, _mm512_clmulepi64_epi128(pk, x1, 0x00));
+					a11 = _mm512_xor_si512(a11, _mm512_clmulepi64_epi128(pk, x1, 0x11));
+					a1m = _mm512_ternarylogic_epi64(a1m,
+						_mm512_clmulepi64_epi128(pk, x1, 0x01),
+						_mm512_clmulepi64_epi128(pk, x1, 0x10), 0x96);
+
+					if (k + 1 < denseSize)
+					{
+						x0 = paxosGf128Mul(x0, d0);
+						x1 = paxosGf128Mul(x1, d1);
+					}
+				}
+
+				v0 = _mm512_xor_si512(v0, paxosGf128Reduce(
+					_mm512_xor_si512(a00, _mm512_bslli_epi128(a0m, 8)),
+					_mm512_xor_si512(a01, _mm512_bsrli_epi128(a0m, 8))));
+				v1 = _mm512_xor_si512(v1, paxosGf128Reduce(
+					_mm512_xor_si512(a10, _mm512_bslli_epi128(a1m, 8)),
+					_mm512_xor_si512(a11, _mm512_bsrli_epi128(a1m, 8))));
+			}
+
+			_mm512_storeu_si512((void*)(values + g), v0);
+			_mm512_storeu_si512((void*)(values + g + 4), v1);
+
+			if (gf128 == false)
+				paxosDecodeBinaryDense8(dense + g, values + g, p2, denseSize);
+		}
+	}
+
+	// the cpu features needed by the decode kernels.
+	inline PaxosDecodeIsa paxosDetectDecodeIsa()
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") &&
+			__builtin_cpu_supports("avx512bw") &&
+			__builtin_cpu_supports("vpclmulqdq"))
+			return PaxosDecodeIsa::Avx512;
+		if (__builtin_cpu_supports("avx2") &&
+			__builtin_cpu_supports("pclmul"))
+			return PaxosDecodeIsa::Avx2;
+		return PaxosDecodeIsa::Scalar;
+	}
+#else
+	inline PaxosDecodeIsa paxosDetectDecodeIsa()
+	{
+		return PaxosDecodeIsa::Scalar;
+	}
+#endif
+
+	inline PaxosDecodeIsa& paxosDecodeIsa()
+	{
+		static PaxosDecodeIsa isa = paxosDetectDecodeIsa();
+		return isa;
+	}
+
+	template<typename IdxType>
+	bool Paxos<IdxType>::decodeBlocks(
+		const IdxType* rows,
+		const block* dense,
+		block* values,
+		const block* p,
+		u64 n) const
+	{
+#ifdef PAXOS_SIMD_DECODE
+		auto gf128 = mDt == DenseType::GF128;
+		switch (paxosDecodeIsa())
+		{
+		case PaxosDecodeIsa::Avx512:
+			paxosDecodeAvx512(rows, dense, values, p, n, mWeight, mSparseSize, mDenseSize, gf128);
+			return true;
+		case PaxosDecodeIsa::Avx2:
+			paxosDecodeAvx2(rows, dense, values, p, n, mWeight, mSparseSize, mDenseSize, gf128);
+			return true;
+		default:
+			return false;
+		}
+#else
+		return false;
+#endif
+	}
+
+	template<typename IdxType>
+	template<typename ValueType, typename Helper, typename Vec>
+	void Paxos<IdxType>::decode32(
+		const IdxType* rows_,
+		const block* dense_,
+		ValueType* values_,
+		Vec& p_,
+		Helper& h) const
+	{
+		//{
+		//	auto r = rows_;
+		//	auto d = dense_;
+		//	auto v = values_;
+		//	auto& p = p_;
+
+		//	for (u64 j = 0; j < 4; ++j)
+		//	{
+		//		decode8(r, d, v, p, h);
+		//		r += 8 * mWeight;
+		//		d += 8;
+		//		v = h.iterPlus(v, 8);
+		//	}
+		//	return;
+		//}
+
+		if constexpr (std::is_same<ValueType, block>::value && isBlockVecHelper<Helper>)
+		{
+			if (decodeBlocks(rows_, dense_, values_, p_[0], 32))
+				return;
+		}
+
+		const ValueType* __restrict p = p_[0];
 
 		for (u64 j = 0; j < 4; ++j)
 		{
@@ -1891,7 +2564,7 @@ namespace volePSI
 		}
 
 
-		if (mDt == DenseType::GF128)
+		if (mDt == DenseType::GF128 && mDenseSize)
 		{
 			const ValueType* __restrict p2 = h.iterPlus(p, mSparseSize);
 
@@ -2026,8 +2699,14 @@ namespace volePSI
 		const block* dense_,
 		ValueType* values_,
 		Vec& p_,
-		Helper& h)
+		Helper& h) const
 	{
+		if constexpr (std::is_same<ValueType, block>::value && isBlockVecHelper<Helper>)
+		{
+			if (decodeBlocks(rows_, dense_, values_, p_[0], 8))
+				return;
+		}
+
 		//const block* __restrict xx = xx_;
 		const IdxType* __restrict rows = rows_;
 		const block* __restrict dense = dense_;
@@ -2075,7 +2754,7 @@ namespace volePSI
 		}
 
 
-		if (mDt == DenseType::GF128)
+		if (mDt == DenseType::GF128 && mDenseSize)
 		{
 			const ValueType* __restrict p2 = h.iterPlus(p, mSparseSize);
 
@@ -2187,7 +2866,7 @@ namespace volePSI
 		const block* dense,
 		ValueType* values,
 		Vec& p,
-		Helper& h)
+		Helper& h) const
 	{
 		h.assign(values, p[rows[0]]);
 		for (u64 j = 1; j < mWeight; ++j)
@@ -2198,7 +2877,7 @@ namespace volePSI
 
 		//auto p2 = p.subspan(mSparseSize);
 
-		if (mDt == DenseType::GF128)
+		if (mDt == DenseType::GF128 && mDenseSize)
 		{
 			block x = *dense;
 			h.multAdd(values, p[mSparseSize], x);
@@ -2242,7 +2921,30 @@ namespace volePSI
 		if (colIter != mColBacking.data() + mColBacking.size())
 			throw RTE_LOC;
 
-		if (mRows.cols() == 3)
+		if (mNumThreads > 1 && mNumItems >= gPaxosParInputMinSize)
+		{
+			// each thread fills its own range of columns. The rows are
+			// visited in order so the columns are the same as below.
+			runThreads(mNumThreads, [&](u64 thrdIdx)
+			{
+				u64 cBegin = mSparseSize * thrdIdx / mNumThreads;
+				u64 cWidth = mSparseSize * (thrdIdx + 1) / mNumThreads - cBegin;
+				for (u64 i = 0; i < mNumItems; ++i)
+				{
+					for (auto c : mRows[i])
+					{
+						if (u64(c) - cBegin < cWidth)
+						{
+							auto& col = mCols[c];
+							auto s = col.size();
+							col = span<IdxType>(col.data(), s + 1);
+							col[s] = static_cast<IdxType>(i);
+						}
+					}
+				}
+			});
+		}
+		else if (mRows.cols() == 3)
 		{
 			auto iter = mRows.data();
 			for (IdxType i = 0; i < mNumItems; ++i)
@@ -2285,6 +2987,32 @@ namespace volePSI
 		}
 	}
 
+	template<typename IdxType>
+	void Paxos<IdxType>::countColumns(MatrixView<const IdxType> rows, span<IdxType> colWeights) const
+	{
+		if (colWeights.size() != mSparseSize)
+			throw RTE_LOC;
+
+		// thread thrdIdx only counts the columns [cBegin, cBegin + cWidth)
+		// so that no two threads write the same counter.
+		auto numThreads = rows.rows() >= gPaxosParInputMinSize ? std::max<u64>(1, mNumThreads) : 1;
+		auto count = [&](u64 thrdIdx)
+		{
+			u64 cBegin = mSparseSize * thrdIdx / numThreads;
+			u64 cWidth = mSparseSize * (thrdIdx + 1) / numThreads - cBegin;
+			for (auto c : span<const IdxType>(rows.data(), rows.size()))
+			{
+				if (u64(c) - cBegin < cWidth)
+					++colWeights[c];
+			}
+		};
+
+		if (numThreads > 1)
+			runThreads(numThreads, count);
+		else
+			count(0);
+	}
+
 	template<typename IdxType>
 	typename Paxos<IdxType>::FCInv Paxos<IdxType>::getFCInv(
 		span<IdxType> mainRows,
@@ -2301,78 +3029,104 @@ namespace volePSI
 		// logical algorithm. This inverts the row index.
 		auto invertRowIdx = [m](auto i) { return m - i - 1; };
 
-		for (u64 i = 0; i < gapRows.size(); ++i)
-		{
-			if (std::memcmp(
+		auto isDuplicate = [&](u64 i) {
+			return std::memcmp(
 				mRows[gapRows[i][0]].data(),
 				mRows[gapRows[i][1]].data(),
-				mWeight * sizeof(IdxType)) == 0)
+				mWeight * sizeof(IdxType)) == 0;
+		};
+
+		// for the general case we need to implicitly create the C
+		// matrix. The issue is that currently C is defined by mainRows
+		// and mainCols and this form isn't ideal for the computation 
+		// of computing F C^-1. In particular, we will need to know which
+		// columns of the overall matrix H live in C. To do this we will construct
+		// colMapping. For columns of H that are in C, colMapping will give us
+		// the column in C. We only construct this mapping when its needed,
+		// before any of the rows are processed so that they can be 
+		// processed in parallel.
+		for (u64 i = 0; i < gapRows.size(); ++i)
+		{
+			if (isDuplicate(i) == false)
+			{
+				colMapping.resize(size(), -1);
+				for (u64 j = 0; j < m; ++j)
+					colMapping[mainCols[invertRowIdx(j)]] = j;
+				break;
+			}
+		}
+
+		auto getRow = [&](u64 i)
+		{
+			if (isDuplicate(i))
 			{
 				// special/common case where FC^-1 [i] = 0000100000
 				// where the 1 is at position gapRows[i][1]. This code is
 				// used to speed up this common case.
 				ret.mMtx[i].push_back(gapRows[i][1]);
+				return;
 			}
-			else
-			{
-				// for the general case we need to implicitly create the C
-				// matrix. The issue is that currently C is defined by mainRows
-				// and mainCols and this form isn't ideal for the computation 
-				// of computing F C^-1. In particular, we will need to know which
-				// columns of the overall matrix H live in C. To do this we will construct
-				// colMapping. For columns of H that are in C, colMapping will give us
-				// the column in C. We only construct this mapping when its needed.
-				if (colMapping.size() == 0)
-				{
-					colMapping.resize(size(), -1);
-					for (u64 i = 0; i < m; ++i)
-						colMapping[mainCols[invertRowIdx(i)]] = i;
-				}
 
-				// the current row of F. We initialize this as just F_i
-				// and then Xor in rows of C until its the zero row.
-				std::set<IdxType, std::greater<IdxType>> row;
-				for (u64 j = 0; j < mWeight; ++j)
-				{
-					auto c1 = mRows(gapRows[i][0], j);
-					if (colMapping[c1] != IdxType(-1))
-						row.insert(colMapping[c1]);
-				}
+			// the current row of F. We initialize this as just F_i
+			// and then Xor in rows of C until its the zero row.
+			std::set<IdxType, std::greater<IdxType>> row;
+			for (u64 j = 0; j < mWeight; ++j)
+			{
+				auto c1 = mRows(gapRows[i][0], j);
+				if (colMapping[c1] != IdxType(-1))
+					row.insert(colMapping[c1]);
+			}
 
-				while (row.size())
-				{
-					// the column of C, F that we will cancel (by adding
-					// the corresponding row of C to F_i. We will pick the 
-					// row of C as the row with index CCol.
-					auto CCol = *row.begin();
+			while (row.size())
+			{
+				// the column of C, F that we will cancel (by adding
+				// the corresponding row of C to F_i. We will pick the 
+				// row of C as the row with index CCol.
+				auto CCol = *row.begin();
 
-					// the row of C we will add to F_i
-					auto CRow = CCol;
+				// the row of C we will add to F_i
+				auto CRow = CCol;
 
-					// the row of H that we will add to F_i
-					auto HRow = mainRows[invertRowIdx(CRow)];
-					ret.mMtx[i].push_back(HRow);
+				// the row of H that we will add to F_i
+				auto HRow = mainRows[invertRowIdx(CRow)];
+				ret.mMtx[i].push_back(HRow);
 
-					for (auto HCol : mRows[HRow])
+				for (auto HCol : mRows[HRow])
+				{
+					auto CCol2 = colMapping[HCol];
+					if (CCol2 != IdxType(-1))
 					{
-						auto CCol2 = colMapping[HCol];
-						if (CCol2 != IdxType(-1))
-						{
-							assert(CCol2 <= CCol);
-
-							// Xor in the row CRow from C into the current
-							// row of F
-							auto iter = row.find(CCol2);
-							if (iter == row.end())
-								row.insert(CCol2);
-							else
-								row.erase(iter);
-						}
+						assert(CCol2 <= CCol);
+
+						// Xor in the row CRow from C into the current
+						// row of F
+						auto iter = row.find(CCol2);
+						if (iter == row.end())
+							row.insert(CCol2);
+						else
+							row.erase(iter);
 					}
-
-					assert(row.size() == 0 || *row.begin() != CCol);
 				}
+
+				assert(row.size() == 0 || *row.begin() != CCol);
 			}
+		};
+
+		// the rows of F C^-1 are independent. Some take much longer 
+		// than others so the threads take every numThreads'th row.
+		auto numThreads = std::min<u64>(mNumThreads, gapRows.size() / gPaxosParGapMinSize);
+		if (numThreads > 1)
+		{
+			runThreads(numThreads, [&](u64 thrdIdx)
+			{
+				for (u64 i = thrdIdx; i < gapRows.size(); i += numThreads)
+					getRow(i);
+			});
+		}
+		else
+		{
+			for (u64 i = 0; i < gapRows.size(); ++i)
+				getRow(i);
 		}
 
 		return ret;
@@ -2380,8 +3134,8 @@ namespace volePSI
 
 	template<typename IdxType>
 	std::vector<u64> Paxos<IdxType>::getGapCols(
-		FCInv& fcinv,
-		span<std::array<IdxType, 2>> gapRows) const
+		const FCInv& fcinv,
+		span<const std::array<IdxType, 2>> gapRows) const
 	{
 		if (gapRows.size() == 0)
 			return {};
@@ -2400,7 +3154,7 @@ namespace volePSI
 			auto gapCols = oc::ithCombination(ci, mDenseSize, g);
 			++ci;
 			if (ci > e)
-				throw std::runtime_error("failed to find invertible matrix. " LOCATION);
+				throw PaxosSolveError("failed to find invertible matrix. " LOCATION);
 
 			EE.resize(g, g);
 			for (u64 i = 0; i < g; ++i)
@@ -2642,12 +3396,19 @@ namespace volePSI
 		if (p_.size() != size())
 			throw RTE_LOC;
 
+		mBinRetries.clear();
+		mThrdSolveStats.clear();
+
+		// a single bin is not retried, see mMaxBinRetries.
 		if (mNumBins == 1)
 		{
 			Paxos<IdxType> paxos;
 			paxos.init(mNumItems, mPaxosParam, mSeed);
+			paxos.mNumThreads = std::max<u64>(1, numThreads);
 			paxos.setInput(inputs_);
 			paxos.encode(vals_, p_, h, prng);
+			if (mOnBinsSolved)
+				mOnBinsSolved(0, 1);
 
 			//auto v2 = h.newVec(vals_.size());
 			//paxos.decode(inputs_, v2, p_, h);
@@ -2659,6 +3420,9 @@ namespace volePSI
 		}
 
 		numThreads = std::max<u64>(1, numThreads);
+		mThrdSolveStats.assign(numThreads, {});
+		if (mMaxBinRetries)
+			mBinRetries.assign(mNumBins, 0);
 
 		static constexpr const u64 batchSize = 32;
 
@@ -2677,7 +3441,7 @@ namespace volePSI
 		Matrix<u64> thrdBinSizes(numThreads, mNumBins);
 
 		// keeps track of input index of each item in each bin,thread.
-		std::unique_ptr<u64[]> inputMapping(new u64[totalNumBins * perThrdMaxBinSize]);
+		AllocBuffer<u64> inputMapping(totalNumBins * perThrdMaxBinSize);
 
 		// for the given thread, bin, return the list which map the bin 
 		// value back to the input value.
@@ -2701,7 +3465,7 @@ namespace volePSI
 			return valBacking.subspan(binBegin + thrdBegin, perThrdMaxBinSize);
 		};
 
-		std::unique_ptr<block[]> hashBacking(new block[totalNumBins * perThrdMaxBinSize]);
+		AllocBuffer<block> hashBacking(totalNumBins * perThrdMaxBinSize);
 
 		// get the hashes mapped to the given bin by the given thread.
 		auto getHashes = [&](u64 thrdIdx, u64 binIdx)
@@ -2716,12 +3480,27 @@ namespace volePSI
 		libdivide::libdivide_u64_t divider = libdivide::libdivide_u64_gen(mNumBins);
 		AES hasher(mSeed);
 
-		std::atomic<u64> numDone(0);
-		std::promise<void> hashingDoneProm;
-		auto hashingDoneFu = hashingDoneProm.get_future().share();
+		ThreadBarrier hashingDone(numThreads);
+
+		// with mNuma, each node gets a range of bins. Otherwise 
+		// there is a single range that all threads take bins from.
+		NumaBinQueue binQueue(NumaBinSplit(mNumBins, numThreads, mNuma));
+		if (binQueue.mSplit.numNodes() > 1)
+			numaBindBins(p_, binQueue.mSplit);
+
+		// the number of unsolved bins in each range of mOnBinsSolved.
+		auto rangeBins = std::max<u64>(1, mSolvedRangeBins);
+		auto numRanges = mOnBinsSolved ? (mNumBins + rangeBins - 1) / rangeBins : 0;
+		std::unique_ptr<std::atomic<u64>[]> rangeRemaining(new std::atomic<u64>[numRanges]);
+		for (u64 k = 0; k < numRanges; ++k)
+			rangeRemaining[k] = std::min<u64>(mNumBins, (k + 1) * rangeBins) - k * rangeBins;
 
 		auto routine = [&](u64 thrdIdx)
 		{
+			std::unique_ptr<NumaPin> pin;
+			if (binQueue.mSplit.numNodes() > 1)
+				pin.reset(new NumaPin(binQueue.mSplit.nodeOf(thrdIdx)));
+
 			auto begin = (inputs_.size() * thrdIdx) / numThreads;
 			auto end = (inputs_.size() * (thrdIdx + 1)) / numThreads;
 			auto inputs = inputs_.subspan(begin, end - begin);
@@ -2785,30 +3564,25 @@ namespace volePSI
 			}
 
 			auto paxosSizePer = mPaxosParam.size();
-			auto allocSize =
-				sizeof(IdxType) * (
-					mItemsPerBin * mWeight * 2 +
-					mPaxosParam.mSparseSize
-					) +
-				sizeof(span<IdxType>) * mPaxosParam.mSparseSize /*+
-				sizeof(block) * mItemsPerBin*/;
-
-			std::unique_ptr<u8[]> allocation(new u8[allocSize]);
+			AllocBuffer<u8> allocation(binSolveAllocSize<IdxType>());
 
 
 			// block until all threads have mapped all items. 
-			if (++numDone == numThreads)
-				hashingDoneProm.set_value();
-			else
-				hashingDoneFu.get();
+			hashingDone.wait();
 
 			Paxos<IdxType> paxos;
 
+			// with fewer bins than threads, the threads that get no bin
+			// are instead used to solve the bins from within.
+			paxos.mNumThreads = std::max<u64>(1, numThreads / mNumBins);
 
-			// this thread will iterator over its assigned bins. This thread 
-			// will aggregate all the items mapped to the ith bin (which are currently
-			// stored in a per thread local).
-			for (u64 binIdx = thrdIdx; binIdx < mNumBins; binIdx += numThreads)
+			auto solveBegin = std::chrono::steady_clock::now();
+
+			// this thread will take the next unsolved bin until all are done. 
+			// A fixed assignment would leave a thread with a slow bin (a large 
+			// gap) behind the others. This thread will aggregate all the items 
+			// mapped to the ith bin (which are currently stored in a per thread local).
+			for (u64 binIdx = binQueue.next(thrdIdx); binIdx < mNumBins; binIdx = binQueue.next(thrdIdx))
 			{
 				// get the actual bin size.
 				u64 binSize = 0;
@@ -2818,18 +3592,6 @@ namespace volePSI
 				if (binSize > mItemsPerBin)
 					throw RTE_LOC;
 
-				paxos.init(binSize, mPaxosParam, mSeed);
-
-				auto iter = allocation.get();
-				//span<block> hashes = initSpan<block>(iter, binSize);
-				MatrixView<IdxType> rows = initMV<IdxType>(iter, binSize, mWeight);
-				span<IdxType> colBacking = initSpan<IdxType>(iter, binSize * mWeight);
-				span<IdxType> colWeights = initSpan<IdxType>(iter, mPaxosParam.mSparseSize);
-				span<span<IdxType>> cols = initSpan<span<IdxType>>(iter, mPaxosParam.mSparseSize);
-
-				if (iter > allocation.get() + allocSize)
-					throw RTE_LOC;
-
 				auto binBegin = combinedMaxBinSize * binIdx;
 				auto values = valBacking.subspan(binBegin, binSize);
 				auto hashes = span<block>(hashBacking.get() + binBegin, binSize);
@@ -2875,88 +3637,969 @@ namespace volePSI
 					//}
 				}
 
-				// compute the rows and count the column weight.
-				std::memset(colWeights.data(), 0, colWeights.size() * sizeof(IdxType));
-				auto rIter = rows.data();
-				if (mWeight == 3)
-				{
-					auto main = binSize / batchSize * batchSize;
-
-					u64 i = 0;
-					for (; i < main; i += batchSize)
-					{
-						paxos.mHasher.buildRow32(&hashes[i], rIter);
-						for (u64 j = 0; j < batchSize; ++j)
-						{
-							++colWeights[rIter[0]];
-							++colWeights[rIter[1]];
-							++colWeights[rIter[2]];
-							rIter += mWeight;
-						}
-					}
-					for (; i < binSize; ++i)
-					{
-						paxos.mHasher.buildRow(hashes[i], rIter);
+				auto retry = implSolveBin(binIdx, hashes, values, output, prng, h, paxos, allocation.get());
+				if (mBinRetries.size())
+					mBinRetries[binIdx] = static_cast<u8>(retry);
+				++mThrdSolveStats[thrdIdx].mNumBins;
 
-						++colWeights[rIter[0]];
-						++colWeights[rIter[1]];
-						++colWeights[rIter[2]];
-						rIter += mWeight;
-					}
-				}
-				else
+				// the thread that solves the last bin of a range reports it.
+				if (numRanges)
 				{
-					for (u64 i = 0; i < binSize; ++i)
-					{
-						paxos.mHasher.buildRow(hashes[i], rIter);
-						for (u64 k = 0; k < mWeight; ++k)
-							++colWeights[rIter[k]];
-						rIter += mWeight;
-					}
+					auto k = binIdx / rangeBins;
+					if (rangeRemaining[k].fetch_sub(1, std::memory_order_acq_rel) == 1)
+						mOnBinsSolved(k * rangeBins, std::min<u64>(mNumBins, (k + 1) * rangeBins));
 				}
-
-				paxos.setInput(rows, hashes, cols, colBacking, colWeights);
-				paxos.encode(values, output, h, prng);
-
 			}
-		};
 
-		std::vector<std::thread> thrds(numThreads - 1);
-
-		for (u64 i = 0; i < thrds.size(); ++i)
-			thrds[i] = std::thread(routine, i);
-
-		routine(thrds.size());
+			mThrdSolveStats[thrdIdx].mTime = std::chrono::steady_clock::now() - solveBegin;
+		};
 
-		for (u64 i = 0; i < thrds.size(); ++i)
-			thrds[i].join();
+		threadPool()->run(numThreads, hashingDone.abortOnThrow(routine));
 	}
 
-	template<typename ValueType>
-	void Baxos::decode(span<const block> inputs, span<ValueType> values, span<const ValueType> p, u64 numThreads)
+	template<typename IdxType>
+	u64 Baxos::binSolveAllocSize() const
 	{
-		PxVector<ValueType> V(values);
-		PxVector<const ValueType> P(p);
-		auto h = V.defaultHelper();
-
-		decode(inputs, V, P, h, numThreads);
+		return
+			sizeof(IdxType) * (
+				mItemsPerBin * mWeight * 2 +
+				mPaxosParam.mSparseSize
+				) +
+			sizeof(span<IdxType>) * mPaxosParam.mSparseSize;
 	}
 
-
-	template<typename ValueType>
-	void Baxos::decode(span<const block> inputs, MatrixView<ValueType> values, MatrixView<const ValueType> p, u64 numThreads)
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	u64 Baxos::implSolveBin(
+		u64 binIdx,
+		span<block> hashes,
+		ConstVec& values,
+		Vec& output,
+		PRNG* prng,
+		Helper& h,
+		Paxos<IdxType>& paxos,
+		u8* allocation)
 	{
-
-		if (values.cols() != p.cols())
+		// a different seed can not help a bin that is too full.
+		if (hashes.size() > mItemsPerBin)
 			throw RTE_LOC;
 
-		if (values.cols() == 1)
+		auto maxRetries = std::min<u64>(mMaxBinRetries, std::numeric_limits<u8>::max());
+
+		// the hashes before any retry changed them.
+		std::vector<block> original;
+		for (u64 retry = 0;; ++retry)
 		{
-			decode(inputs, span<ValueType>(values), span<const ValueType>(p), numThreads);
-		}
-		else if (
-			values.cols() * sizeof(ValueType) % sizeof(block) == 0 &&
-			std::is_same<ValueType, block>::value == false)
+			try
+			{
+				implSolveBinOnce(hashes, values, output, prng, h, paxos, allocation);
+				return retry;
+			}
+			catch (PaxosSolveError&)
+			{
+				// other errors, e.g. duplicate keys, do not depend on the seed.
+				if (retry == maxRetries)
+					throw;
+			}
+
+			if (original.empty())
+				original.assign(hashes.begin(), hashes.end());
+			AES(binSeed(binIdx, retry + 1)).hashBlocks(original, hashes);
+		}
+	}
+
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	void Baxos::implSolveBinOnce(
+		span<block> hashes,
+		ConstVec& values,
+		Vec& output,
+		PRNG* prng,
+		Helper& h,
+		Paxos<IdxType>& paxos,
+		u8* allocation)
+	{
+		static constexpr const u64 batchSize = 32;
+		auto binSize = hashes.size();
+
+		paxos.init(binSize, mPaxosParam, mSeed);
+
+		auto iter = allocation;
+		MatrixView<IdxType> rows = initMV<IdxType>(iter, binSize, mWeight);
+		span<IdxType> colBacking = initSpan<IdxType>(iter, binSize * mWeight);
+		span<IdxType> colWeights = initSpan<IdxType>(iter, mPaxosParam.mSparseSize);
+		span<span<IdxType>> cols = initSpan<span<IdxType>>(iter, mPaxosParam.mSparseSize);
+
+		if (iter > allocation + binSolveAllocSize<IdxType>())
+			throw RTE_LOC;
+
+		// compute the rows and count the column weight.
+		std::memset(colWeights.data(), 0, colWeights.size() * sizeof(IdxType));
+		auto rIter = rows.data();
+		if (paxos.mNumThreads > 1 && binSize >= gPaxosParInputMinSize)
+		{
+			// each thread builds a range of the rows. The columns are 
+			// then counted by countColumns(...).
+			auto numThreads = paxos.mNumThreads;
+			runThreads(numThreads, [&](u64 thrdIdx)
+			{
+				auto b = binSize * thrdIdx / numThreads / batchSize * batchSize;
+				auto e = thrdIdx + 1 == numThreads ? binSize :
+					binSize * (thrdIdx + 1) / numThreads / batchSize * batchSize;
+
+				auto i = b;
+				if (mWeight == 3)
+				{
+					for (; i + batchSize <= e; i += batchSize)
+						paxos.mHasher.buildRow32(&hashes[i], rows[i].data());
+				}
+				for (; i < e; ++i)
+					paxos.mHasher.buildRow(hashes[i], rows[i].data());
+			});
+
+			paxos.countColumns(MatrixView<const IdxType>(rows.data(), binSize, mWeight), colWeights);
+		}
+		else if (mWeight == 3)
+		{
+			auto main = binSize / batchSize * batchSize;
+
+			u64 i = 0;
+			for (; i < main; i += batchSize)
+			{
+				paxos.mHasher.buildRow32(&hashes[i], rIter);
+				for (u64 j = 0; j < batchSize; ++j)
+				{
+					++colWeights[rIter[0]];
+					++colWeights[rIter[1]];
+					++colWeights[rIter[2]];
+					rIter += mWeight;
+				}
+			}
+			for (; i < binSize; ++i)
+			{
+				paxos.mHasher.buildRow(hashes[i], rIter);
+
+				++colWeights[rIter[0]];
+				++colWeights[rIter[1]];
+				++colWeights[rIter[2]];
+				rIter += mWeight;
+			}
+		}
+		else
+		{
+			for (u64 i = 0; i < binSize; ++i)
+			{
+				paxos.mHasher.buildRow(hashes[i], rIter);
+				for (u64 k = 0; k < mWeight; ++k)
+					++colWeights[rIter[k]];
+				rIter += mWeight;
+			}
+		}
+
+		paxos.setInput(rows, hashes, cols, colBacking, colWeights);
+		paxos.encode(values, output, h, prng);
+	}
+
+	inline BaxosPlan Baxos::getPlan(span<const block> inputs, u64 numThreads)
+	{
+		BaxosPlan plan;
+
+		// select the smallest index type which will work.
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mPaxosParam.mSparseSize + 1)), 8);
+
+		if (bitLength <= 8)
+			implGetPlan<u8>(inputs, plan, numThreads);
+		else if (bitLength <= 16)
+			implGetPlan<u16>(inputs, plan, numThreads);
+		else if (bitLength <= 32)
+			implGetPlan<u32>(inputs, plan, numThreads);
+		else
+			implGetPlan<u64>(inputs, plan, numThreads);
+
+		return plan;
+	}
+
+	template<typename ValueType>
+	void Baxos::encode(BaxosPlan& plan, span<const ValueType> values, span<ValueType> output, PRNG* prng, u64 numThreads)
+	{
+		PxVector<const ValueType> V(values);
+		PxVector<ValueType> P(output);
+		auto h = P.defaultHelper();
+		encode(plan, V, P, prng, numThreads, h);
+	}
+
+	template<typename ValueType>
+	void Baxos::encode(BaxosPlan& plan, MatrixView<const ValueType> values, MatrixView<ValueType> output, PRNG* prng, u64 numThreads)
+	{
+		if (values.cols() != output.cols())
+			throw RTE_LOC;
+
+		if (values.cols() == 1)
+		{
+			encode(plan, span<const ValueType>(values), span<ValueType>(output), prng, numThreads);
+		}
+		else if (
+			values.cols() * sizeof(ValueType) % sizeof(block) == 0 &&
+			std::is_same<ValueType, block>::value == false)
+		{
+			// reduce ValueType to block if possible.
+
+			auto n = values.rows();
+			auto m = values.cols() * sizeof(ValueType) / sizeof(block);
+
+			encode<block>(
+				plan,
+				MatrixView<const block>((block*)values.data(), n, m),
+				MatrixView<block>((block*)output.data(), output.rows(), m),
+				prng,
+				numThreads);
+		}
+		else
+		{
+			PxMatrix<const ValueType> V(values);
+			PxMatrix<ValueType> P(output);
+			auto h = P.defaultHelper();
+			encode(plan, V, P, prng, numThreads, h);
+		}
+	}
+
+	template<typename Vec, typename ConstVec, typename Helper>
+	void Baxos::encode(
+		BaxosPlan& plan,
+		ConstVec& V,
+		Vec& P,
+		PRNG* prng,
+		u64 numThreads,
+		Helper& h)
+	{
+		// select the smallest index type which will work.
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mPaxosParam.mSparseSize + 1)), 8);
+
+		if (bitLength <= 8)
+			implParEncode<u8>(plan, V, P, prng, numThreads, h);
+		else if (bitLength <= 16)
+			implParEncode<u16>(plan, V, P, prng, numThreads, h);
+		else if (bitLength <= 32)
+			implParEncode<u32>(plan, V, P, prng, numThreads, h);
+		else
+			implParEncode<u64>(plan, V, P, prng, numThreads, h);
+	}
+
+	template<typename IdxType>
+	void Baxos::implGetPlan(
+		span<const block> inputs,
+		BaxosPlan& plan,
+		u64 numThreads)
+	{
+		if (inputs.size() != mNumItems)
+			throw RTE_LOC;
+
+		numThreads = std::max<u64>(1, numThreads);
+		plan.mNumItems = mNumItems;
+		auto& bins = plan.bins<IdxType>();
+		bins.resize(mNumBins);
+
+		if (mNumBins == 1)
+		{
+			plan.mInputIdxs.resize(mNumItems);
+			std::iota(plan.mInputIdxs.begin(), plan.mInputIdxs.end(), 0);
+			plan.mBinBegin = { 0, mNumItems };
+
+			auto& paxos = bins[0].mPaxos;
+			paxos.init(mNumItems, mPaxosParam, mSeed);
+			paxos.mNumThreads = numThreads;
+			paxos.setInput(inputs);
+			bins[0].mPlan = paxos.getPlan();
+			return;
+		}
+
+		static constexpr const u64 batchSize = 32;
+		libdivide::libdivide_u64_t divider = libdivide::libdivide_u64_gen(mNumBins);
+		AES hasher(mSeed);
+
+		// the bin of each input and the number of items each thread maps to each bin.
+		std::vector<u64> binIdxs(mNumItems);
+		Matrix<u64> thrdBinSizes(numThreads, mNumBins);
+
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			auto begin = (mNumItems * thrdIdx) / numThreads;
+			auto end = (mNumItems * (thrdIdx + 1)) / numThreads;
+			auto binSizes = thrdBinSizes[thrdIdx];
+
+			std::array<block, batchSize> hashes;
+			u64 i = begin;
+			for (; i + batchSize <= end; i += batchSize)
+			{
+				hasher.hashBlocks<8>(inputs.data() + i + 0, hashes.data() + 0);
+				hasher.hashBlocks<8>(inputs.data() + i + 8, hashes.data() + 8);
+				hasher.hashBlocks<8>(inputs.data() + i + 16, hashes.data() + 16);
+				hasher.hashBlocks<8>(inputs.data() + i + 24, hashes.data() + 24);
+
+				for (u64 k = 0; k < batchSize; ++k)
+					binIdxs[i + k] = binIdxCompress(hashes[k]);
+
+				doMod32(binIdxs.data() + i, &divider, mNumBins);
+
+				for (u64 k = 0; k < batchSize; ++k)
+					++binSizes[binIdxs[i + k]];
+			}
+
+			for (; i < end; ++i)
+			{
+				binIdxs[i] = modNumBins(hasher.hashBlock(inputs[i]));
+				++binSizes[binIdxs[i]];
+			}
+		});
+
+		// compute where each bin begins and where each thread 
+		// should write its items for that bin.
+		plan.mBinBegin.resize(mNumBins + 1);
+		u64 pos = 0;
+		for (u64 binIdx = 0; binIdx < mNumBins; ++binIdx)
+		{
+			plan.mBinBegin[binIdx] = pos;
+			for (u64 i = 0; i < numThreads; ++i)
+			{
+				auto size = thrdBinSizes(i, binIdx);
+				thrdBinSizes(i, binIdx) = pos;
+				pos += size;
+			}
+
+			if (pos - plan.mBinBegin[binIdx] > mItemsPerBin)
+				throw RTE_LOC;
+		}
+		plan.mBinBegin[mNumBins] = pos;
+		plan.mInputIdxs.resize(mNumItems);
+
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			auto begin = (mNumItems * thrdIdx) / numThreads;
+			auto end = (mNumItems * (thrdIdx + 1)) / numThreads;
+			auto binPos = thrdBinSizes[thrdIdx];
+
+			for (u64 i = begin; i < end; ++i)
+				plan.mInputIdxs[binPos[binIdxs[i]]++] = i;
+		});
+
+		// triangulate the bins. The rows of a bin are derived from the 
+		// same hash that mapped the item to the bin.
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			std::vector<block> binInputs(mItemsPerBin);
+			for (u64 binIdx = thrdIdx; binIdx < mNumBins; binIdx += numThreads)
+			{
+				auto begin = plan.mBinBegin[binIdx];
+				auto binSize = plan.mBinBegin[binIdx + 1] - begin;
+				for (u64 i = 0; i < binSize; ++i)
+					binInputs[i] = inputs[plan.mInputIdxs[begin + i]];
+
+				auto& paxos = bins[binIdx].mPaxos;
+				paxos.init(binSize, mPaxosParam, mSeed);
+				paxos.setInput(span<const block>(binInputs.data(), binSize));
+				bins[binIdx].mPlan = paxos.getPlan();
+			}
+		});
+	}
+
+	inline void Baxos::beginInput(BaxosPlan& plan)
+	{
+		// select the smallest index type which will work.
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mPaxosParam.mSparseSize + 1)), 8);
+
+		if (bitLength <= 8)
+			implBeginInput<u8>(plan);
+		else if (bitLength <= 16)
+			implBeginInput<u16>(plan);
+		else if (bitLength <= 32)
+			implBeginInput<u32>(plan);
+		else
+			implBeginInput<u64>(plan);
+	}
+
+	inline void Baxos::addInputs(BaxosPlan& plan, span<const block> inputs)
+	{
+		// select the smallest index type which will work.
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mPaxosParam.mSparseSize + 1)), 8);
+
+		if (bitLength <= 8)
+			implAddInputs<u8>(plan, inputs);
+		else if (bitLength <= 16)
+			implAddInputs<u16>(plan, inputs);
+		else if (bitLength <= 32)
+			implAddInputs<u32>(plan, inputs);
+		else
+			implAddInputs<u64>(plan, inputs);
+	}
+
+	inline void Baxos::finishInput(BaxosPlan& plan, u64 numThreads)
+	{
+		// select the smallest index type which will work.
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mPaxosParam.mSparseSize + 1)), 8);
+
+		if (bitLength <= 8)
+			implFinishInput<u8>(plan, numThreads);
+		else if (bitLength <= 16)
+			implFinishInput<u16>(plan, numThreads);
+		else if (bitLength <= 32)
+			implFinishInput<u32>(plan, numThreads);
+		else
+			implFinishInput<u64>(plan, numThreads);
+	}
+
+	template<typename IdxType>
+	void Baxos::implBeginInput(BaxosPlan& plan)
+	{
+		plan = {};
+		auto& bins = plan.bins<IdxType>();
+		bins.resize(mNumBins);
+
+		if (mNumBins == 1)
+		{
+			bins[0].mPaxos.init(mNumItems, mPaxosParam, mSeed);
+			bins[0].mPaxos.beginInput(mNumItems);
+			return;
+		}
+
+		// each bin reserves room for mItemsPerBin items.
+		plan.mInputIdxs.resize(mNumBins * mItemsPerBin);
+		for (auto& bin : bins)
+		{
+			bin.mPaxos.init(mItemsPerBin, mPaxosParam, mSeed);
+			bin.mPaxos.beginInput(mItemsPerBin);
+		}
+	}
+
+	template<typename IdxType>
+	void Baxos::implAddInputs(BaxosPlan& plan, span<const block> inputs)
+	{
+		auto& bins = plan.bins<IdxType>();
+		if (bins.size() != mNumBins || plan.mBinBegin.size())
+			throw std::runtime_error("beginInput(...) must be called before addInputs(...). " LOCATION);
+		if (plan.mNumItems + inputs.size() > mNumItems)
+			throw RTE_LOC;
+
+		if (mNumBins == 1)
+		{
+			bins[0].mPaxos.addInputs(inputs);
+			plan.mNumItems += inputs.size();
+			return;
+		}
+
+		static constexpr const u64 batchSize = 32;
+		libdivide::libdivide_u64_t divider = libdivide::libdivide_u64_gen(mNumBins);
+		AES hasher(mSeed);
+
+		std::array<block, batchSize> hashes;
+		std::array<u64, batchSize> binIdxs;
+
+		// the bin hash is also the hash that the paxos of the bin builds
+		// the row from, see getPlan(...). The hashes of each bin are staged
+		// and added batchSize at a time so that the rows are built with
+		// buildRow32(...).
+		std::vector<block> staged(mNumBins * batchSize);
+		std::vector<u8> numStaged(mNumBins);
+		auto flush = [&](u64 binIdx)
+		{
+			bins[binIdx].mPaxos.addHashes(span<const block>(staged.data() + binIdx * batchSize, numStaged[binIdx]));
+			numStaged[binIdx] = 0;
+		};
+
+		auto addToBin = [&](u64 binIdx, const block& hash)
+		{
+			auto pos = bins[binIdx].mPaxos.mInputPos + numStaged[binIdx];
+			if (pos == mItemsPerBin)
+				throw RTE_LOC;
+
+			plan.mInputIdxs[binIdx * mItemsPerBin + pos] = plan.mNumItems++;
+			staged[binIdx * batchSize + numStaged[binIdx]++] = hash;
+			if (numStaged[binIdx] == batchSize)
+				flush(binIdx);
+		};
+
+		u64 i = 0;
+		for (; i + batchSize <= inputs.size(); i += batchSize)
+		{
+			hasher.hashBlocks<8>(inputs.data() + i + 0, hashes.data() + 0);
+			hasher.hashBlocks<8>(inputs.data() + i + 8, hashes.data() + 8);
+			hasher.hashBlocks<8>(inputs.data() + i + 16, hashes.data() + 16);
+			hasher.hashBlocks<8>(inputs.data() + i + 24, hashes.data() + 24);
+
+			for (u64 k = 0; k < batchSize; ++k)
+				binIdxs[k] = binIdxCompress(hashes[k]);
+
+			doMod32(binIdxs.data(), &divider, mNumBins);
+
+			for (u64 k = 0; k < batchSize; ++k)
+				addToBin(binIdxs[k], hashes[k]);
+		}
+
+		for (; i < inputs.size(); ++i)
+		{
+			auto hash = hasher.hashBlock(inputs[i]);
+			addToBin(modNumBins(hash), hash);
+		}
+
+		for (u64 binIdx = 0; binIdx < mNumBins; ++binIdx)
+			if (numStaged[binIdx])
+				flush(binIdx);
+	}
+
+	template<typename IdxType>
+	void Baxos::implFinishInput(BaxosPlan& plan, u64 numThreads)
+	{
+		auto& bins = plan.bins<IdxType>();
+		if (bins.size() != mNumBins || plan.mBinBegin.size())
+			throw std::runtime_error("beginInput(...) must be called before finishInput(...). " LOCATION);
+
+		// fewer keys than reserved may have been added. The bins keep 
+		// their size.
+		mNumItems = plan.mNumItems;
+		numThreads = std::max<u64>(1, numThreads);
+
+		if (mNumBins == 1)
+		{
+			plan.mInputIdxs.resize(mNumItems);
+			std::iota(plan.mInputIdxs.begin(), plan.mInputIdxs.end(), 0);
+			plan.mBinBegin = { 0, mNumItems };
+
+			auto& paxos = bins[0].mPaxos;
+			paxos.mNumThreads = numThreads;
+			paxos.finishInput();
+			bins[0].mPlan = paxos.getPlan();
+			return;
+		}
+
+		// move the input indices of each bin next to each other. 
+		// The bins only move towards the front.
+		plan.mBinBegin.resize(mNumBins + 1);
+		u64 pos = 0;
+		for (u64 binIdx = 0; binIdx < mNumBins; ++binIdx)
+		{
+			auto binSize = bins[binIdx].mPaxos.mInputPos;
+			auto src = plan.mInputIdxs.begin() + binIdx * mItemsPerBin;
+			std::copy(src, src + binSize, plan.mInputIdxs.begin() + pos);
+
+			plan.mBinBegin[binIdx] = pos;
+			pos += binSize;
+		}
+		plan.mBinBegin[mNumBins] = pos;
+		plan.mInputIdxs.resize(pos);
+		plan.mInputIdxs.shrink_to_fit();
+
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			for (u64 binIdx = thrdIdx; binIdx < mNumBins; binIdx += numThreads)
+			{
+				auto& paxos = bins[binIdx].mPaxos;
+				paxos.finishInput();
+				bins[binIdx].mPlan = paxos.getPlan();
+			}
+		});
+	}
+
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	void Baxos::implParEncode(
+		BaxosPlan& plan,
+		ConstVec& vals_,
+		Vec& p_,
+		PRNG* prng,
+		u64 numThreads,
+		Helper& h)
+	{
+		if (p_.size() != size())
+			throw RTE_LOC;
+		if (plan.mNumItems != mNumItems || vals_.size() != mNumItems)
+			throw RTE_LOC;
+
+		auto& bins = plan.bins<IdxType>();
+		if (bins.size() != mNumBins)
+			throw RTE_LOC;
+
+		// plans are made with the original seed of every bin.
+		mBinRetries.clear();
+
+		if (mNumBins == 1)
+		{
+			bins[0].mPaxos.encode(bins[0].mPlan, vals_, p_, h, prng);
+			return;
+		}
+
+		numThreads = std::max<u64>(1, numThreads);
+		auto paxosSizePer = mPaxosParam.size();
+
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			// the values of the current bin.
+			auto valBacking = h.newVec(mItemsPerBin);
+
+			for (u64 binIdx = thrdIdx; binIdx < mNumBins; binIdx += numThreads)
+			{
+				auto begin = plan.mBinBegin[binIdx];
+				auto binSize = plan.mBinBegin[binIdx + 1] - begin;
+				auto values = valBacking.subspan(0, binSize);
+				for (u64 i = 0; i < binSize; ++i)
+					h.assign(values[i], vals_[plan.mInputIdxs[begin + i]]);
+
+				auto output = p_.subspan(paxosSizePer * binIdx, paxosSizePer);
+				bins[binIdx].mPaxos.encode(bins[binIdx].mPlan, values, output, h, prng);
+			}
+		});
+	}
+
+	template<typename ValueType>
+	std::vector<std::pair<u64, u64>> Baxos::update(
+		BaxosPlan& plan,
+		span<const block> insertKeys,
+		span<const ValueType> insertValues,
+		span<const block> removeKeys,
+		span<ValueType> p,
+		PRNG* prng,
+		u64 numThreads)
+	{
+		PxVector<const ValueType> V(insertValues);
+		PxVector<ValueType> P(p);
+		auto h = P.defaultHelper();
+		return update(plan, insertKeys, V, removeKeys, P, prng, numThreads, h);
+	}
+
+	template<typename ValueType>
+	std::vector<std::pair<u64, u64>> Baxos::update(
+		BaxosPlan& plan,
+		span<const block> insertKeys,
+		MatrixView<const ValueType> insertValues,
+		span<const block> removeKeys,
+		MatrixView<ValueType> p,
+		PRNG* prng,
+		u64 numThreads)
+	{
+		if (insertValues.cols() != p.cols())
+			throw RTE_LOC;
+
+		if (insertValues.cols() == 1)
+		{
+			return update(plan, insertKeys, span<const ValueType>(insertValues), removeKeys, span<ValueType>(p), prng, numThreads);
+		}
+		else if (
+			insertValues.cols() * sizeof(ValueType) % sizeof(block) == 0 &&
+			std::is_same<ValueType, block>::value == false)
+		{
+			// reduce ValueType to block if possible.
+
+			auto n = insertValues.rows();
+			auto m = insertValues.cols() * sizeof(ValueType) / sizeof(block);
+
+			return update<block>(
+				plan,
+				insertKeys,
+				MatrixView<const block>((block*)insertValues.data(), n, m),
+				removeKeys,
+				MatrixView<block>((block*)p.data(), p.rows(), m),
+				prng,
+				numThreads);
+		}
+		else
+		{
+			PxMatrix<const ValueType> V(insertValues);
+			PxMatrix<ValueType> P(p);
+			auto h = P.defaultHelper();
+			return update(plan, insertKeys, V, removeKeys, P, prng, numThreads, h);
+		}
+	}
+
+	template<typename Vec, typename ConstVec, typename Helper>
+	std::vector<std::pair<u64, u64>> Baxos::update(
+		BaxosPlan& plan,
+		span<const block> insertKeys,
+		ConstVec& V,
+		span<const block> removeKeys,
+		Vec& P,
+		PRNG* prng,
+		u64 numThreads,
+		Helper& h)
+	{
+		// select the smallest index type which will work.
+		auto bitLength = oc::roundUpTo(oc::log2ceil((u64)(mPaxosParam.mSparseSize + 1)), 8);
+
+		if (bitLength <= 8)
+			return implUpdate<u8>(plan, insertKeys, V, removeKeys, P, prng, numThreads, h);
+		else if (bitLength <= 16)
+			return implUpdate<u16>(plan, insertKeys, V, removeKeys, P, prng, numThreads, h);
+		else if (bitLength <= 32)
+			return implUpdate<u32>(plan, insertKeys, V, removeKeys, P, prng, numThreads, h);
+		else
+			return implUpdate<u64>(plan, insertKeys, V, removeKeys, P, prng, numThreads, h);
+	}
+
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	std::vector<std::pair<u64, u64>> Baxos::implUpdate(
+		BaxosPlan& plan,
+		span<const block> insertKeys,
+		ConstVec& insertValues,
+		span<const block> removeKeys,
+		Vec& p_,
+		PRNG* prng,
+		u64 numThreads,
+		Helper& h)
+	{
+		if (p_.size() != size())
+			throw RTE_LOC;
+		if (static_cast<u64>(insertValues.size()) != insertKeys.size())
+			throw RTE_LOC;
+
+		auto& bins = plan.bins<IdxType>();
+		if (plan.mNumItems != mNumItems || bins.size() != mNumBins)
+			throw RTE_LOC;
+
+		numThreads = std::max<u64>(1, numThreads);
+		auto paxosSizePer = mPaxosParam.size();
+		auto oldNumItems = mNumItems;
+		AES hasher(mSeed);
+
+		// map the keys to their bins in the same way as solve(...). The 
+		// keys of bin i are keys[order[begin[i]]], ..., keys[order[begin[i+1]-1]].
+		auto groupByBin = [&](
+			span<const block> keys,
+			std::vector<block>& hashes,
+			std::vector<u64>& begin,
+			std::vector<u64>& order)
+		{
+			hashes.resize(keys.size());
+			hasher.hashBlocks(keys, hashes);
+
+			std::vector<u64> binIdxs(keys.size());
+			begin.assign(mNumBins + 1, 0);
+			for (u64 i = 0; i < keys.size(); ++i)
+			{
+				binIdxs[i] = modNumBins(hashes[i]);
+				++begin[binIdxs[i] + 1];
+			}
+			for (u64 i = 0; i < mNumBins; ++i)
+				begin[i + 1] += begin[i];
+
+			std::vector<u64> pos(begin.begin(), begin.end() - 1);
+			order.resize(keys.size());
+			for (u64 i = 0; i < keys.size(); ++i)
+				order[pos[binIdxs[i]]++] = i;
+		};
+
+		std::vector<block> insHashes, remHashes;
+		std::vector<u64> insBegin, insOrder, remBegin, remOrder;
+		groupByBin(insertKeys, insHashes, insBegin, insOrder);
+		groupByBin(removeKeys, remHashes, remBegin, remOrder);
+
+		// the bins which have an inserted or removed key and the new bin sizes.
+		std::vector<u64> changed, newBinSizes(mNumBins);
+		for (u64 binIdx = 0; binIdx < mNumBins; ++binIdx)
+		{
+			auto binSize = plan.mBinBegin[binIdx + 1] - plan.mBinBegin[binIdx];
+			auto numIns = insBegin[binIdx + 1] - insBegin[binIdx];
+			auto numRem = remBegin[binIdx + 1] - remBegin[binIdx];
+
+			if (numRem > binSize || binSize - numRem + numIns > mItemsPerBin)
+				throw RTE_LOC;
+
+			newBinSizes[binIdx] = binSize - numRem + numIns;
+			if (numIns || numRem)
+				changed.push_back(binIdx);
+		}
+
+		// for each changed bin, the position of the items that are kept 
+		// and the input index of the items that are removed.
+		std::vector<std::vector<IdxType>> keep(changed.size());
+		std::vector<std::vector<u64>> removed(changed.size());
+		std::atomic<bool> missing(false);
+
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			for (u64 k = thrdIdx; k < changed.size(); k += numThreads)
+			{
+				auto binIdx = changed[k];
+				auto begin = plan.mBinBegin[binIdx];
+				auto binSize = plan.mBinBegin[binIdx + 1] - begin;
+				auto& paxos = bins[binIdx].mPaxos;
+
+				std::unordered_set<block> remSet;
+				for (u64 i = remBegin[binIdx]; i < remBegin[binIdx + 1]; ++i)
+					remSet.insert(remHashes[remOrder[i]]);
+
+				keep[k].reserve(binSize);
+				for (u64 i = 0; i < binSize; ++i)
+				{
+					if (remSet.count(paxos.mDense[i]))
+						removed[k].push_back(plan.mInputIdxs[begin + i]);
+					else
+						keep[k].push_back(static_cast<IdxType>(i));
+				}
+
+				if (removed[k].size() != remBegin[binIdx + 1] - remBegin[binIdx])
+					missing = true;
+			}
+		});
+
+		// a removed key is not part of the plan or was given twice.
+		if (missing)
+			throw RTE_LOC;
+
+		// the input index of each item in the changed bins. The inserted 
+		// key insertKeys[i] is given the index oldNumItems + i.
+		std::vector<std::vector<u64>> binItems(changed.size());
+
+		// the changed bins are solved into newBins and newP. They replace 
+		// the old ones once all bins are solved, so that p and plan are 
+		// unchanged if a bin fails.
+		std::vector<BaxosBinPlan<IdxType>> newBins(changed.size());
+		auto newP = h.newVec(changed.size() * paxosSizePer);
+
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			auto valBacking = h.newVec(mItemsPerBin);
+			Matrix<IdxType> rows(mItemsPerBin, mWeight);
+			std::vector<block> dense(mItemsPerBin);
+
+			for (u64 k = thrdIdx; k < changed.size(); k += numThreads)
+			{
+				auto binIdx = changed[k];
+				auto begin = plan.mBinBegin[binIdx];
+				auto binSize = newBinSizes[binIdx];
+				auto& paxos = bins[binIdx].mPaxos;
+				auto& newPaxos = newBins[k].mPaxos;
+				auto oldOutput = p_.subspan(paxosSizePer * binIdx, paxosSizePer);
+				auto output = newP.subspan(paxosSizePer * k, paxosSizePer);
+				auto values = valBacking.subspan(0, binSize);
+				auto& items = binItems[k];
+				items.resize(binSize);
+
+				// the kept items retain their row and their current value.
+				u64 j = 0;
+				for (auto i : keep[k])
+				{
+					paxos.decode1(paxos.mRows[i].data(), &paxos.mDense[i], values[j], oldOutput, h);
+					std::copy(paxos.mRows[i].begin(), paxos.mRows[i].end(), rows[j].begin());
+					dense[j] = paxos.mDense[i];
+					items[j] = plan.mInputIdxs[begin + i];
+					++j;
+				}
+
+				for (u64 i = insBegin[binIdx]; i < insBegin[binIdx + 1]; ++i, ++j)
+				{
+					auto inIdx = insOrder[i];
+					dense[j] = insHashes[inIdx];
+					paxos.mHasher.buildRow(dense[j], rows[j].data());
+					h.assign(values[j], insertValues[inIdx]);
+					items[j] = oldNumItems + inIdx;
+				}
+
+				newPaxos.init(binSize, mPaxosParam, mSeed);
+				newPaxos.setInput(
+					MatrixView<IdxType>(rows.data(), binSize, mWeight),
+					span<block>(dense.data(), binSize));
+				newBins[k].mPlan = newPaxos.getPlan();
+				newPaxos.encode(newBins[k].mPlan, values, output, h, prng);
+			}
+		});
+
+		// the new index of a kept item is its old index minus the number 
+		// of removed items before it. The latter is counted per 64 items.
+		std::vector<u64> removedWords((oldNumItems + 63) / 64), removedBefore(removedWords.size());
+		for (auto& r : removed)
+			for (auto i : r)
+				removedWords[i / 64] |= 1ull << (i % 64);
+
+		u64 numRemoved = 0;
+		for (u64 i = 0; i < removedWords.size(); ++i)
+		{
+			removedBefore[i] = numRemoved;
+			numRemoved += std::bitset<64>(removedWords[i]).count();
+		}
+
+		auto numKept = oldNumItems - numRemoved;
+		auto remap = [&](u64 i) -> u64
+		{
+			if (i >= oldNumItems)
+				return numKept + i - oldNumItems;
+
+			auto mask = (1ull << (i % 64)) - 1;
+			return i - removedBefore[i / 64] - std::bitset<64>(removedWords[i / 64] & mask).count();
+		};
+
+		std::vector<u64> changedIdx(mNumBins, ~0ull);
+		for (u64 k = 0; k < changed.size(); ++k)
+			changedIdx[changed[k]] = k;
+
+		std::vector<u64> binBegin(mNumBins + 1);
+		for (u64 binIdx = 0; binIdx < mNumBins; ++binIdx)
+			binBegin[binIdx + 1] = binBegin[binIdx] + newBinSizes[binIdx];
+
+		std::vector<u64> inputIdxs(binBegin.back());
+		runThreads(numThreads, [&](u64 thrdIdx)
+		{
+			for (u64 binIdx = thrdIdx; binIdx < mNumBins; binIdx += numThreads)
+			{
+				auto dst = inputIdxs.data() + binBegin[binIdx];
+				if (changedIdx[binIdx] != ~0ull)
+				{
+					for (auto i : binItems[changedIdx[binIdx]])
+						*dst++ = remap(i);
+				}
+				else
+				{
+					for (u64 i = plan.mBinBegin[binIdx]; i < plan.mBinBegin[binIdx + 1]; ++i)
+						*dst++ = remap(plan.mInputIdxs[i]);
+				}
+			}
+		});
+
+		// all bins were solved, replace the old ones.
+		for (u64 k = 0; k < changed.size(); ++k)
+		{
+			auto binIdx = changed[k];
+			bins[binIdx] = std::move(newBins[k]);
+			for (u64 i = 0; i < paxosSizePer; ++i)
+				h.assign(p_[paxosSizePer * binIdx + i], newP[paxosSizePer * k + i]);
+		}
+
+		plan.mInputIdxs = std::move(inputIdxs);
+		plan.mBinBegin = std::move(binBegin);
+		plan.mNumItems = mNumItems = numKept + insertKeys.size();
+
+		// the changed bins as ranges of p.
+		std::vector<std::pair<u64, u64>> ranges;
+		for (auto binIdx : changed)
+		{
+			auto b = paxosSizePer * binIdx;
+			if (ranges.size() && ranges.back().second == b)
+				ranges.back().second = b + paxosSizePer;
+			else
+				ranges.emplace_back(b, b + paxosSizePer);
+		}
+
+		return ranges;
+	}
+
+	template<typename ValueType>
+	void Baxos::decode(span<const block> inputs, span<ValueType> values, span<const ValueType> p, u64 numThreads)
+	{
+		PxVector<ValueType> V(values);
+		PxVector<const ValueType> P(p);
+		auto h = V.defaultHelper();
+
+		decode(inputs, V, P, h, numThreads);
+	}
+
+
+	template<typename ValueType>
+	void Baxos::decode(span<const block> inputs, MatrixView<ValueType> values, MatrixView<const ValueType> p, u64 numThreads)
+	{
+
+		if (values.cols() != p.cols())
+			throw RTE_LOC;
+
+		if (values.cols() == 1)
+		{
+			decode(inputs, span<ValueType>(values), span<const ValueType>(p), numThreads);
+		}
+		else if (
+			values.cols() * sizeof(ValueType) % sizeof(block) == 0 &&
+			std::is_same<ValueType, block>::value == false)
 		{
 			// reduce ValueType to block if possible.
 
@@ -3016,6 +4659,11 @@ namespace volePSI
 
 		assert(mWeight <= maxWeightSize);
 		std::array<IdxType, maxWeightSize* batchSize> _backing;
+
+		// the bin was solved for its keys hashed again, see implSolveBin.
+		if (auto retry = binRetries(binIdx))
+			AES(binSeed(binIdx, retry)).hashBlocks(hashes, hashes);
+
 		MatrixView<IdxType> row(_backing.data(), batchSize, mWeight);
 		assert(valuesBuff.size() >= batchSize);
 		//std::array<block, decodeSize> vals;
@@ -3060,7 +4708,7 @@ namespace volePSI
 
 
 	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
-	void Baxos::implDecodeBatch(span<const block> inputs, Vec& values, ConstVec& pp, Helper& h)
+	void Baxos::implDecodeBatch(span<const block> inputs, Vec& values, ConstVec& pp, Helper& h, u64 binBegin, u64 binEnd)
 	{
 		u64 decodeSize = std::min<u64>(512, inputs.size());
 		Matrix<block> batches(mNumBins, decodeSize);
@@ -3108,6 +4756,8 @@ namespace volePSI
 			for (u64 k = 0; k < batchSize; ++k)
 			{
 				auto binIdx = binIdxs[k];
+				if (binIdx < binBegin || binIdx >= binEnd)
+					continue;
 
 				batches(binIdx, batchSizes[binIdx]) = buffer[k];
 				inIdxs(binIdx, batchSizes[binIdx]) = i + k;
@@ -3131,6 +4781,8 @@ namespace volePSI
 
 			//auto binIdx = buffer[k].as<u64>()[0] % mNumBins;
 			auto binIdx = modNumBins(buffer[k]);
+			if (binIdx < binBegin || binIdx >= binEnd)
+				continue;
 
 			batches(binIdx, batchSizes[binIdx]) = buffer[k];
 			inIdxs(binIdx, batchSizes[binIdx]) = i + k;
@@ -3162,6 +4814,176 @@ namespace volePSI
 	}
 
 
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	void Baxos::implDecodePartitioned(span<const block> inputs, Vec& values, ConstVec& pp, Helper& h, u64 binBegin, u64 binEnd)
+	{
+		binEnd = std::min<u64>(binEnd, mNumBins);
+		if (binBegin >= binEnd || inputs.size() == 0)
+			return;
+
+		// bins are stored relative to binBegin, skipped inputs get numBins.
+		auto numBins = binEnd - binBegin;
+		if (numBins >= ~u32(0))
+			throw RTE_LOC;
+
+		// the inputs are partitioned in chunks whose buffers take at most
+		// scratchBytes, however many bins there are. With few bins the 
+		// runs are long, with many they get shorter.
+		static constexpr u64 scratchBytes = 1 << 22;
+		static constexpr u64 entryBytes = 2 * sizeof(block) + sizeof(u32) + sizeof(u64);
+		auto chunkSize = std::min<u64>(inputs.size(), scratchBytes / entryBytes);
+		AllocBuffer<block> hashes(chunkSize), sorted(chunkSize);
+		AllocBuffer<u32> bins(chunkSize);
+		AllocBuffer<u64> idxs(chunkSize);
+
+		// offsets[b] is where the run of bin b begins in sorted.
+		std::vector<u64> offsets(numBins + 2), cursor(numBins + 1);
+
+		AES hasher(mSeed);
+		Paxos<IdxType> paxos;
+		auto sizePer = size() / mNumBins;
+		paxos.init(1, mPaxosParam, mSeed);
+		auto buff = h.newVec(32);
+
+		static const u32 batchSize = 32;
+		std::array<u64, batchSize> binIdxs;
+		libdivide::libdivide_u64_t divider = libdivide::libdivide_u64_gen(mNumBins);
+		auto relBin = [&](u64 binIdx) -> u32 {
+			return binIdx - binBegin < numBins ? binIdx - binBegin : numBins;
+		};
+
+		for (u64 begin = 0; begin < inputs.size(); begin += chunkSize)
+		{
+			auto n = std::min<u64>(chunkSize, inputs.size() - begin);
+			auto inIter = inputs.data() + begin;
+			std::fill(offsets.begin(), offsets.end(), 0);
+
+			// pass 1, hash the chunk and count the inputs of each bin.
+			u64 i = 0;
+			auto main = n / batchSize * batchSize;
+			for (; i < main; i += batchSize)
+			{
+				hasher.hashBlocks<8>(inIter + i, hashes.data() + i);
+				hasher.hashBlocks<8>(inIter + i + 8, hashes.data() + i + 8);
+				hasher.hashBlocks<8>(inIter + i + 16, hashes.data() + i + 16);
+				hasher.hashBlocks<8>(inIter + i + 24, hashes.data() + i + 24);
+
+				for (u64 k = 0; k < batchSize; ++k)
+					binIdxs[k] = binIdxCompress(hashes[i + k]);
+
+				doMod32(binIdxs.data(), &divider, mNumBins);
+
+				for (u64 k = 0; k < batchSize; ++k)
+				{
+					bins[i + k] = relBin(binIdxs[k]);
+					++offsets[bins[i + k] + 1];
+				}
+			}
+
+			for (; i < n; ++i)
+			{
+				hashes[i] = hasher.hashBlock(inIter[i]);
+				bins[i] = relBin(modNumBins(hashes[i]));
+				++offsets[bins[i] + 1];
+			}
+
+			for (u64 b = 0; b <= numBins; ++b)
+				offsets[b + 1] += offsets[b];
+			std::copy(offsets.begin(), offsets.end() - 1, cursor.begin());
+
+			// pass 2, scatter the hashes and their input index into bin order.
+			for (i = 0; i < n; ++i)
+			{
+				auto j = cursor[bins[i]]++;
+				sorted[j] = hashes[i];
+				idxs[j] = begin + i;
+			}
+
+			// decode the run of each bin, which writes the values 
+			// back to their input positions.
+			for (u64 b = 0; b < numBins; ++b)
+			{
+				auto s = offsets[b];
+				auto e = offsets[b + 1];
+				if (s != e)
+				{
+					auto binIdx = binBegin + b;
+					auto p = pp.subspan(binIdx * sizePer, sizePer);
+					span<block> hh(sorted.data() + s, e - s);
+					span<u64> ii(idxs.data() + s, e - s);
+					implDecodeBin(binIdx, hh, values, buff, ii, p, h, paxos);
+				}
+			}
+		}
+	}
+
+
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
+	void Baxos::implDecodeSmall(span<const block> inputs, Vec& values, ConstVec& pp, Helper& h)
+	{
+		if (inputs.size() > smallDecodeSize)
+			throw RTE_LOC;
+
+		std::array<block, smallDecodeSize> hashes;
+		std::array<u64, smallDecodeSize> binIdxs;
+		AES hasher(mSeed);
+		hasher.hashBlocks(inputs, span<block>(hashes.data(), inputs.size()));
+		for (u64 i = 0; i < inputs.size(); ++i)
+			binIdxs[i] = modNumBins(hashes[i]);
+
+		Paxos<IdxType> paxos;
+		paxos.init(1, mPaxosParam, mSeed);
+
+		decodeBinHashes(paxos, span<block>(hashes.data(), inputs.size()), binIdxs.data(),
+			size() / mNumBins, mAddToDecode, values, 0, pp, h,
+			[&](u64 binIdx, block& hash)
+			{
+				if (auto retry = binRetries(binIdx))
+					hash = AES(binSeed(binIdx, retry)).hashBlock(hash);
+			});
+	}
+
+	template<typename IdxType, typename Vec, typename ConstVec, typename Helper, typename Rehash>
+	void Baxos::decodeBinHashes(
+		const Paxos<IdxType>& paxos,
+		span<block> hashes,
+		const u64* binIdxs,
+		u64 sizePer,
+		bool addToDecode,
+		Vec& values,
+		u64 valueBegin,
+		ConstVec& p,
+		Helper& h,
+		Rehash&& rehash)
+	{
+		static constexpr const u64 maxWeightSize = 20;
+		if (paxos.mWeight > maxWeightSize)
+			throw RTE_LOC;
+
+		std::array<IdxType, maxWeightSize> row;
+
+		// only needed to add to the output.
+		auto buff = h.newVec(addToDecode ? 1 : 0);
+
+		for (u64 i = 0; i < hashes.size(); ++i)
+		{
+			auto binIdx = binIdxs[i];
+			rehash(binIdx, hashes[i]);
+
+			paxos.mHasher.buildRow(hashes[i], row.data());
+			auto pp = p.subspan(binIdx * sizePer, sizePer);
+			auto v = values[valueBegin + i];
+
+			if (addToDecode)
+			{
+				paxos.decode1(row.data(), &hashes[i], buff[0], pp, h);
+				h.add(v, buff[0]);
+			}
+			else
+				paxos.decode1(row.data(), &hashes[i], v, pp, h);
+		}
+	}
+
 	template<typename IdxType, typename Vec, typename ConstVec, typename Helper>
 	void Baxos::implParDecode(
 		span<const block> inputs,
@@ -3179,26 +5001,54 @@ namespace volePSI
 			return;
 		}
 
+		// a few keys are cheaper to decode one at a time on this thread.
+		if (inputs.size() <= smallDecodeSize)
+		{
+			implDecodeSmall<IdxType>(inputs, values, pp, h);
+			return;
+		}
 
 		numThreads = std::max<u64>(numThreads, 1ull);
 
-		std::vector<std::thread> thrds(numThreads - 1);
+		NumaBinSplit split(mNumBins, numThreads, mNuma);
+		if (split.numNodes() > 1)
+		{
+			// the threads of each node split all of the inputs between them
+			// and decode those that map to the node's bins. Each input is 
+			// hashed once per node, which is cheap compared to reading p 
+			// from another node.
+			threadPool()->run(numThreads, [&](u64 thrdIdx)
+			{
+				auto node = split.nodeOf(thrdIdx);
+				auto j = split.localIdx(thrdIdx);
+				auto nt = split.numNodeThreads(node);
+				NumaPin pin(node);
+
+				auto begin = (inputs.size() * j) / nt;
+				auto end = (inputs.size() * (j + 1)) / nt;
+				span<const block> in(inputs.begin() + begin, inputs.begin() + end);
+				auto va = values.subspan(begin, end - begin);
+				if (mPartitionDecode)
+					implDecodePartitioned<IdxType>(in, va, pp, h, split.mBinBegin[node], split.mBinBegin[node + 1]);
+				else
+					implDecodeBatch<IdxType>(in, va, pp, h, split.mBinBegin[node], split.mBinBegin[node + 1]);
+			});
+			return;
+		}
+
 		auto routine = [&](u64 i)
 		{
 			auto begin = (inputs.size() * i) / numThreads;
 			auto end = (inputs.size() * (i + 1)) / numThreads;
 			span<const block> in(inputs.begin() + begin, inputs.begin() + end);
 			auto va = values.subspan(begin, end - begin);
-			implDecodeBatch<IdxType>(in, va, pp, h);
+			if (mPartitionDecode)
+				implDecodePartitioned<IdxType>(in, va, pp, h);
+			else
+				implDecodeBatch<IdxType>(in, va, pp, h);
 		};
 
-		for (u64 i = 0; i < thrds.size(); ++i)
-			thrds[i] = std::thread(routine, i);
-
-		routine(thrds.size());
-
-		for (u64 i = 0; i < thrds.size(); ++i)
-			thrds[i].join();
+		threadPool()->run(numThreads, routine);
 	}
 
 
@@ -4,7 +4,11 @@
 #include <array>
 #include <vector>
 #include <set>
+#include <mutex>
+#include <condition_variable>
 #include "Defines.h"
+#include "Alloc.h"
+#include "ThreadPool.h"
 
 #ifdef ENABLE_SSE
 	#define LIBDIVIDE_AVX2
@@ -496,7 +500,7 @@ namespace volePSI
 		using iterator = T*;
 		using const_iterator = const T*;
 
-		std::unique_ptr<value_type[]> mOwning;
+		AllocBuffer<value_type> mOwning;
 		span<value_type> mElements;
 
 		PxVector() = default;
@@ -513,7 +517,7 @@ namespace volePSI
 		{}
 
 		PxVector(u64 size)
-			: mOwning(new value_type[size])
+			: mOwning(size)
 			, mElements(mOwning.get(), size)
 		{ }
 
@@ -610,6 +614,12 @@ namespace volePSI
 		}
 	};
 
+	// true if Helper is the helper of a contiguous block vector,
+	// i.e. PxVector<block> or PxVector<const block>.
+	template<typename Helper>
+	constexpr bool isBlockVecHelper =
+		std::is_same<Helper, typename PxVector<block>::Helper>::value ||
+		std::is_same<Helper, typename PxVector<const block>::Helper>::value;
 
 
 	// A Paxos vector type when the elements are each 
@@ -623,7 +633,7 @@ namespace volePSI
 		using iterator = T*;
 		using const_iterator = const T*;
 
-		std::unique_ptr<value_type[]> mOwning;
+		AllocBuffer<value_type> mOwning;
 		span<T> mElements;
 		u64 mRows = 0, mCols = 0;
 
@@ -643,7 +653,7 @@ namespace volePSI
 		{}
 
 		PxMatrix(u64 rows, u64 cols)
-			: mOwning(new value_type[rows * cols])
+			: mOwning(rows * cols)
 			, mElements(mOwning.get(), rows * cols)
 			, mRows(rows)
 			, mCols(cols)
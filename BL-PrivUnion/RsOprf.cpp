@@ -1,27 +1,305 @@
 #include "RsOprf.h"
+#include "Gf128.h"
+#include <macoro/thread_pool.h>
+#include <macoro/start_on.h>
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
 
 namespace volePSI
 {
+	namespace
+	{
+		// the minimum number of items per thread before the hashing 
+		// passes of the OPRF run in parallel.
+		constexpr u64 gOprfParMinSize = 1 << 12;
+
+		// call routine(begin, end) for contiguous ranges that cover [0, n)
+		// on up to numThreads threads. Each range is a multiple of 8, the
+		// last one also takes the remainder.
+		template<typename Routine>
+		void parallelRanges(u64 n, u64 numThreads, Routine&& routine)
+		{
+			numThreads = std::max<u64>(1, std::min<u64>(numThreads, n / gOprfParMinSize));
+			if (numThreads == 1)
+			{
+				routine(0, n);
+				return;
+			}
+
+			threadPool()->run(numThreads, [&](u64 thrdIdx)
+			{
+				auto begin = n * thrdIdx / numThreads / 8 * 8;
+				auto end = thrdIdx + 1 == numThreads ? n :
+					n * (thrdIdx + 1) / numThreads / 8 * 8;
+				routine(begin, end);
+			});
+		}
+
+		// compute p[i] ^= c[i] for all i.
+		void xorInplace(span<block> p, span<const block> c)
+		{
+			auto main = (p.size() / 8) * 8;
+			block* __restrict pp = p.data();
+			const block* __restrict cc = c.data();
+			for (u64 i = 0; i < main; i += 8)
+			{
+				pp[0] = pp[0] ^ cc[0];
+				pp[1] = pp[1] ^ cc[1];
+				pp[2] = pp[2] ^ cc[2];
+				pp[3] = pp[3] ^ cc[3];
+				pp[4] = pp[4] ^ cc[4];
+				pp[5] = pp[5] ^ cc[5];
+				pp[6] = pp[6] ^ cc[6];
+				pp[7] = pp[7] ^ cc[7];
+
+				pp += 8;
+				cc += 8;
+			}
+			for (u64 i = main; i < p.size(); ++i, ++pp, ++cc)
+				*pp = *pp ^ *cc;
+		}
+
+		// the ranges of bins that Baxos::solve(...) has finished, see 
+		// Baxos::mOnBinsSolved, followed by one more that is set once
+		// solve(...) has returned. The receiver waits on them to send 
+		// the solved part of the paxos while the rest is solved.
+		struct SolvedBins
+		{
+			std::mutex mMtx;
+			std::condition_variable mCv;
+			std::vector<u8> mDone;
+			u64 mRangeBins = 1;
+			std::exception_ptr mException;
+
+			// the coroutine that waits for range mWaitIdx, if any.
+			std::coroutine_handle<> mWaiter;
+			u64 mWaitIdx = 0;
+
+			void init(u64 numBins, u64 rangeBins)
+			{
+				mRangeBins = rangeBins;
+				mDone.assign((numBins + rangeBins - 1) / rangeBins + 1, 0);
+			}
+
+			// the index of the range that is set once solve(...) has returned.
+			u64 finishedIdx() const { return mDone.size() - 1; }
+
+			// mark the range that begins at binBegin as solved.
+			void set(u64 binBegin) { release(binBegin / mRangeBins); }
+
+			// solve(...) has returned.
+			void finish() { release(finishedIdx()); }
+
+			// the solve failed, the waiter rethrows ex. Also finishes.
+			void fail(std::exception_ptr ex)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mMtx);
+					mException = ex;
+				}
+				release(finishedIdx());
+			}
+
+			// mark range k as done and resume the waiter if it waits 
+			// for k or the solve failed. Nothing is touched after the
+			// resume, the waiter may have freed this.
+			void release(u64 k)
+			{
+				auto h = std::coroutine_handle<>{};
+				{
+					std::lock_guard<std::mutex> lock(mMtx);
+					mDone[k] = 1;
+					if (mWaiter && (mDone[mWaitIdx] || mException))
+						h = std::exchange(mWaiter, {});
+					mCv.notify_all();
+				}
+
+				if (h)
+					h.resume();
+			}
+
+			bool ready(u64 k) const { return mDone[k] || mException; }
+
+			// completes once the k'th range is done or the solve failed. 
+			// The coroutine is resumed on the thread that called set(...),
+			// finish() or fail(...).
+			struct Awaiter
+			{
+				SolvedBins& mBins;
+				u64 mIdx;
+
+				bool await_ready()
+				{
+					std::lock_guard<std::mutex> lock(mBins.mMtx);
+					return mBins.ready(mIdx);
+				}
+
+				bool await_suspend(std::coroutine_handle<> h)
+				{
+					std::lock_guard<std::mutex> lock(mBins.mMtx);
+					if (mBins.ready(mIdx))
+						return false;
+
+					mBins.mWaiter = h;
+					mBins.mWaitIdx = mIdx;
+					return true;
+				}
+
+				void await_resume() {}
+			};
+
+			Awaiter wait(u64 k) { return { *this, k }; }
+
+			// block until the k'th range is done or the solve failed.
+			void block(u64 k)
+			{
+				std::unique_lock<std::mutex> lock(mMtx);
+				mCv.wait(lock, [&] { return ready(k); });
+			}
+
+			// rethrow the exception of the solve, if any.
+			void rethrow()
+			{
+				std::lock_guard<std::mutex> lock(mMtx);
+				if (mException)
+					std::rethrow_exception(mException);
+			}
+		};
+
+		// wait for the k'th range of solved. With an executor, the 
+		// coroutine is resumed by the solving thread and then moves to
+		// the executor, so that it neither blocks an executor thread
+		// nor runs on a solving one. Without one the thread blocks.
+		Proto waitSolved(SolvedBins& solved, u64 k, macoro::thread_pool* executor)
+		{
+			if (executor)
+			{
+				co_await(solved.wait(k));
+				co_await(executor->schedule());
+			}
+			else
+				solved.block(k);
+
+			solved.rethrow();
+		}
+
+		Proto sendChunk(Socket& chl, span<block> chunk)
+		{
+			co_await(chl.send(std::move(chunk)));
+		}
+
+		Proto recvChunk(Socket& chl, span<block> chunk)
+		{
+			co_await(chl.recv(chunk));
+		}
+
+		// the minimum number of correlations in each part of a split vole.
+		constexpr u64 gVoleMinPartSize = 1 << 20;
+
+		// the most parts that a vole of n correlations is split into. A
+		// malicious vole is checked per part and nothing binds the parts
+		// to the same d, a sender could use a different d in each part and
+		// learn from which outputs are wrong. So it is never split.
+		u64 maxVoleParts(u64 n, u64 cap, bool malicious)
+		{
+			if (malicious)
+				return 1;
+			return std::max<u64>(1, std::min<u64>(cap, n / gVoleMinPartSize));
+		}
+
+		// the threads that the parts of a split vole run on when the oprf
+		// has no executor. Created on first use with a thread per core and
+		// kept for the life of the process, since a part's continuation 
+		// may run on one of them.
+		macoro::thread_pool& voleExecutor()
+		{
+			struct Executor
+			{
+				macoro::thread_pool mPool;
+				decltype(std::declval<macoro::thread_pool&>().make_work()) mWork = mPool.make_work();
+
+				Executor()
+				{
+					mPool.create_threads(std::max<u64>(1, std::thread::hardware_concurrency()));
+				}
+			};
+
+			static Executor* executor = new Executor;
+			return executor->mPool;
+		}
+
+		// run the protos at the same time on executor, or voleExecutor() 
+		// if there is none. Continues on executor once all are done.
+		Proto runParallel(std::vector<Proto> protos, macoro::thread_pool* executor)
+		{
+			auto started = std::vector<macoro::eager_task<void>>{};
+			auto ex = std::exception_ptr{};
+			auto pool = executor ? executor : &voleExecutor();
+
+			for (auto& proto : protos)
+				started.push_back(std::move(proto) | macoro::start_on(*pool) | macoro::make_eager());
+
+			// wait for all of them before an error is rethrown.
+			for (auto& task : started)
+			{
+				try
+				{
+					co_await(task);
+				}
+				catch (...)
+				{
+					if (!ex)
+						ex = std::current_exception();
+				}
+			}
+
+			// the last part may have completed on a socket's thread.
+			if (executor)
+				co_await(executor->schedule());
+
+			if (ex)
+				std::rethrow_exception(ex);
+		}
+	}
+
 	Proto RsOprfSender::send(u64 n, PRNG& prng, Socket& chl, u64 numThreads, bool reducedRounds)
 	{
 		auto ws = block{};
 		auto hBuff = std::array<u8, 32> {};
 		auto ro = oc::RandomOracle(32);
-		auto pPtr = std::unique_ptr<block[]>{};
-		auto pp = span<block>{};
+		auto pPtr = AllocBuffer<block>{};
 		auto subPp = span<block>{};
 		auto remB = span<block>{};
 		auto subB = span<block>{};
-		auto fu = macoro::eager_task<void>{};
+		auto recvFu = macoro::eager_task<void>{};
 		auto recvIdx = u64{ 0 };
+		auto chunkSize = u64{ 0 };
+		auto voleParts = u64{ 0 };
+		auto maxParts = u64{ 1 };
+		auto voleId = block{};
+		auto peerVoleId = block{};
 		auto fork = Socket{};
+		auto dKey = Gf128Key{};
 
 		setTimePoint("RsOprfSender::send-begin");
 		ws = prng.get();
 
-		mPaxos.init(n, mBinSize, 3, mSsp, PaxosParam::GF128, oc::ZeroBlock);
+		mPaxos.init(n, mBinSize, mWeight, mSsp, PaxosParam::GF128, oc::ZeroBlock);
 
-		mD = prng.get();
+		if (mStoredVole.loaded() && (
+			mStoredVole.mRole != VoleFileHeader::SenderRole ||
+			mStoredVole.mMalicious != mMalicious ||
+			mStoredVole.mSize < mPaxos.size()))
+			throw std::runtime_error("the stored vole does not fit this send. " LOCATION);
+
+		mD = mStoredVole.loaded() ? mStoredVole.mD : prng.get();
+		dKey.setKey(mD);
 
 		if (mMalicious)
 		{
@@ -35,16 +313,41 @@ namespace volePSI
 			mVoleSender.setTimer(*mTimer);
 
 		numThreads = std::max<u64>(1, numThreads);
-		//mVoleSender.mNumThreads = numThreads;
-		// a + b  = c * d
-		fork = chl.fork();
-		fu = genVole(prng, fork, reducedRounds)
-			| macoro::make_eager();
+
+		// both parties must use the voles of the same offline run, or
+		// neither. Each sends its vole id, zero for none, before it 
+		// checks the other's so that both see a mismatch.
+		voleId = mStoredVole.loaded() ? mStoredVole.mVoleId : oc::ZeroBlock;
+		co_await(chl.send(block(voleId)));
+
+		// the receiver decides how many parts the vole is split into, at
+		// most maxParts.
+		maxParts = maxVoleParts(mPaxos.size(), mMaxVoleParts, mMalicious);
+		co_await(chl.send(u64(maxParts)));
 
 		co_await(chl.recv(mPaxos.mSeed));
+		co_await(chl.recv(peerVoleId));
+		if (peerVoleId != voleId)
+			throw std::runtime_error("the receiver does not use the same stored vole. " LOCATION);
+		co_await(chl.recv(chunkSize));
+		co_await(chl.recv(voleParts));
+		if (chunkSize == 0 || voleParts == 0 || voleParts > maxParts)
+			throw RTE_LOC;
 		setTimePoint("RsOprfSender::recv-seed");
-		co_await(fu);
-		mB = mVoleSender.mB;
+
+		// a + b  = c * d
+		if (mStoredVole.loaded())
+		{
+			// the stored vole is only used once, eval(...) still needs mB.
+			mVoleBacking = std::move(mStoredVole.mB);
+			mStoredVole.clear();
+			mB = span<block>(mVoleBacking.data(), mPaxos.size());
+		}
+		else
+		{
+			fork = chl.fork();
+			co_await(genVole(prng, fork, reducedRounds, voleParts));
+		}
 		setTimePoint("RsOprfSender::send-vole");
 
 
@@ -58,90 +361,38 @@ namespace volePSI
 			setTimePoint("RsOprfSender::recv-mal");
 		}
 
-		pPtr.reset(new block[mPaxos.size()]);
-		pp = span<block>(pPtr.get(), mPaxos.size());
+		// the paxos is received in chunks into two buffers. The next 
+		// chunk is received into one while the other is multiplied 
+		// into mB.
+		chunkSize = std::min<u64>(chunkSize, mPaxos.size());
+		pPtr.reset(2 * chunkSize);
 
 		setTimePoint("RsOprfSender::alloc ");
 
-		if (0)
-		{
-			co_await(chl.recv(pp));
-
-			setTimePoint("RsOprfSender::send-recv");
-			{
+		remB = mB.subspan(0, mPaxos.size());
+		if (remB.size())
+			recvFu = recvChunk(chl, span<block>(pPtr.get(), std::min<u64>(remB.size(), chunkSize)))
+				| macoro::make_eager();
 
-				auto main = mB.size() / 8 * 8;
-				auto b = mB.data();
-				auto p = pp.data();
-				for (u64 i = 0; i < main; i += 8)
-				{
-					b[0] = b[0] ^ mD.gf128Mul(p[0]);
-					b[1] = b[1] ^ mD.gf128Mul(p[1]);
-					b[2] = b[2] ^ mD.gf128Mul(p[2]);
-					b[3] = b[3] ^ mD.gf128Mul(p[3]);
-					b[4] = b[4] ^ mD.gf128Mul(p[4]);
-					b[5] = b[5] ^ mD.gf128Mul(p[5]);
-					b[6] = b[6] ^ mD.gf128Mul(p[6]);
-					b[7] = b[7] ^ mD.gf128Mul(p[7]);
-
-					b += 8;
-					p += 8;
-				}
-
-				for (u64 i = main; i < mB.size(); ++i)
-				{
-					mB[i] = mB[i] ^ mD.gf128Mul(pp[i]);
-				}
-			}
-			setTimePoint("RsOprfSender::send-gf128Mul");
-		}
-		else
+		while (remB.size())
 		{
-			remB = mB;
+			subB = remB.subspan(0, std::min<u64>(remB.size(), chunkSize));
+			remB = remB.subspan(subB.size());
+			subPp = span<block>(pPtr.get() + (recvIdx % 2) * chunkSize, subB.size());
 
-			while (pp.size())
-			{
-
-				subPp = pp.subspan(0, std::min<u64>(pp.size(), 1 << 28));
-				pp = pp.subspan(subPp.size());
+			co_await(recvFu);
+			setTimePoint("RsOprfSender::recv-" + std::to_string(recvIdx));
 
-				subB = remB.subspan(0, subPp.size());
-				remB = remB.subspan(subPp.size());
+			if (remB.size())
+				recvFu = recvChunk(chl, span<block>(pPtr.get() + (recvIdx + 1) % 2 * chunkSize, std::min<u64>(remB.size(), chunkSize)))
+					| macoro::make_eager();
 
-				setTimePoint("RsOprfSender::pre*-" + std::to_string(recvIdx));
-				co_await chl.recv(subPp);
-				setTimePoint("RsOprfSender::recv-" + std::to_string(recvIdx));
+			parallelRanges(subPp.size(), numThreads, [&](u64 begin, u64 end) {
+				gf128MulConstAdd(subPp.subspan(begin, end - begin), dKey, subB.subspan(begin, end - begin));
+			});
+			setTimePoint("RsOprfSender::gf128Mul-" + std::to_string(recvIdx));
 
-				{
-
-					auto main = subB.size() / 8 * 8;
-					auto b = subB.data();
-					auto p = subPp.data();
-					for (u64 i = 0; i < main; i += 8)
-					{
-						b[0] = b[0] ^ mD.gf128Mul(p[0]);
-						b[1] = b[1] ^ mD.gf128Mul(p[1]);
-						b[2] = b[2] ^ mD.gf128Mul(p[2]);
-						b[3] = b[3] ^ mD.gf128Mul(p[3]);
-						b[4] = b[4] ^ mD.gf128Mul(p[4]);
-						b[5] = b[5] ^ mD.gf128Mul(p[5]);
-						b[6] = b[6] ^ mD.gf128Mul(p[6]);
-						b[7] = b[7] ^ mD.gf128Mul(p[7]);
-
-						b += 8;
-						p += 8;
-					}
-
-					for (u64 i = main; i < subB.size(); ++i, ++b, ++p)
-					{
-						*b = *b ^ mD.gf128Mul(*p);
-					}
-				}
-				setTimePoint("RsOprfSender::gf128Mul-" + std::to_string(recvIdx));
-
-				++recvIdx;
-
-			}
+			++recvIdx;
 		}
 	}
 
@@ -159,106 +410,178 @@ namespace volePSI
 
 		setTimePoint("RsOprfSender::eval-decode");
 
-		auto main = val.size() / 8 * 8;
-		auto o = output.data();
-		auto v = val.data();
-		std::array<block, 8> h;
+		Gf128Key dKey(mD);
 
-		// todo, parallelize this.
-		if (mMalicious)
+		// hash and mix the outputs [begin, end).
+		auto hashRange = [&](u64 begin, u64 end)
 		{
-			oc::MultiKeyAES<8> hasher;
+			auto main = begin + (end - begin) / 8 * 8;
+			auto o = output.data() + begin;
+			auto v = val.data() + begin;
+			std::array<block, 8> h;
 
-			//main = 0;
-			for (u64 i = 0; i < main; i += 8)
+			if (mMalicious)
 			{
-				oc::mAesFixedKey.hashBlocks<8>(v, h.data());
-				o[0] = o[0] ^ mD.gf128Mul(h[0]);
-				o[1] = o[1] ^ mD.gf128Mul(h[1]);
-				o[2] = o[2] ^ mD.gf128Mul(h[2]);
-				o[3] = o[3] ^ mD.gf128Mul(h[3]);
-				o[4] = o[4] ^ mD.gf128Mul(h[4]);
-				o[5] = o[5] ^ mD.gf128Mul(h[5]);
-				o[6] = o[6] ^ mD.gf128Mul(h[6]);
-				o[7] = o[7] ^ mD.gf128Mul(h[7]);
-
-
-				o[0] = o[0] ^ mW;
-				o[1] = o[1] ^ mW;
-				o[2] = o[2] ^ mW;
-				o[3] = o[3] ^ mW;
-				o[4] = o[4] ^ mW;
-				o[5] = o[5] ^ mW;
-				o[6] = o[6] ^ mW;
-				o[7] = o[7] ^ mW;
-
-				hasher.setKeys({ o, 8 });
-				hasher.hashNBlocks(v, o);
-
-				o += 8;
-				v += 8;
+				oc::MultiKeyAES<8> hasher;
+
+				for (u64 i = begin; i < main; i += 8)
+				{
+					oc::mAesFixedKey.hashBlocks<8>(v, h.data());
+					gf128MulConstAdd(h, dKey, { o, 8 });
+
+
+					o[0] = o[0] ^ mW;
+					o[1] = o[1] ^ mW;
+					o[2] = o[2] ^ mW;
+					o[3] = o[3] ^ mW;
+					o[4] = o[4] ^ mW;
+					o[5] = o[5] ^ mW;
+					o[6] = o[6] ^ mW;
+					o[7] = o[7] ^ mW;
+
+					hasher.setKeys({ o, 8 });
+					hasher.hashNBlocks(v, o);
+
+					o += 8;
+					v += 8;
+				}
+				for (u64 i = main; i < end; ++i)
+				{
+					auto h = oc::mAesFixedKey.hashBlock(val[i]);
+					output[i] = output[i] ^ mD.gf128Mul(h);
+
+					output[i] = output[i] ^ mW;
+					output[i] = oc::AES(output[i]).hashBlock(val[i]);
+				}
 			}
-			for (u64 i = main; i < val.size(); ++i)
+			else
 			{
-				auto h = oc::mAesFixedKey.hashBlock(val[i]);
-				output[i] = output[i] ^ mD.gf128Mul(h);
+				for (u64 i = begin; i < main; i += 8)
+				{
+					oc::mAesFixedKey.hashBlocks<8>(v, h.data());
+					//auto h = v;
 
-				output[i] = output[i] ^ mW;
-				output[i] = oc::AES(output[i]).hashBlock(val[i]);
-			}
-		}
-		else
-		{
+					gf128MulConstAdd(h, dKey, { o, 8 });
 
-			for (u64 i = 0; i < main; i += 8)
-			{
-				oc::mAesFixedKey.hashBlocks<8>(v, h.data());
-				//auto h = v;
-
-				o[0] = o[0] ^ mD.gf128Mul(h[0]);
-				o[1] = o[1] ^ mD.gf128Mul(h[1]);
-				o[2] = o[2] ^ mD.gf128Mul(h[2]);
-				o[3] = o[3] ^ mD.gf128Mul(h[3]);
-				o[4] = o[4] ^ mD.gf128Mul(h[4]);
-				o[5] = o[5] ^ mD.gf128Mul(h[5]);
-				o[6] = o[6] ^ mD.gf128Mul(h[6]);
-				o[7] = o[7] ^ mD.gf128Mul(h[7]);
-
-				oc::mAesFixedKey.hashBlocks<8>(o, o);
-
-				o += 8;
-				v += 8;
+					oc::mAesFixedKey.hashBlocks<8>(o, o);
+
+					o += 8;
+					v += 8;
+				}
+
+				for (u64 i = main; i < end; ++i)
+				{
+					auto h = oc::mAesFixedKey.hashBlock(val[i]);
+					output[i] = output[i] ^ mD.gf128Mul(h);
+					output[i] = oc::mAesFixedKey.hashBlock(output[i]);
+				}
 			}
+		};
 
+		parallelRanges(val.size(), numThreads, hashRange);
 
+		setTimePoint("RsOprfSender::eval-hash");
 
-			for (u64 i = main; i < val.size(); ++i)
-			{
-				auto h = oc::mAesFixedKey.hashBlock(val[i]);
-				output[i] = output[i] ^ mD.gf128Mul(h);
-				output[i] = oc::mAesFixedKey.hashBlock(output[i]);
-			}
+	}
+
+	Proto RsOprfSender::genVole(PRNG& prng, Socket& chl, bool reduceRounds, u64 numParts)
+	{
+		using VoleSender = oc::SilentVoleSender<block, block, oc::CoeffCtxGF128>;
+		auto n = u64{ mPaxos.size() };
+		auto parts = std::vector<std::unique_ptr<VoleSender>>{};
+		auto prngs = std::vector<PRNG>{};
+		auto socks = std::vector<Socket>{};
+		auto protos = std::vector<Proto>{};
+
+		if (numParts <= 1)
+		{
+			if (reduceRounds)
+				mVoleSender.configure(n, oc::SilentBaseType::Base);
+
+			co_await(mVoleSender.silentSendInplace(mD, n, prng, chl));
+			mB = mVoleSender.mB;
+			co_return;
 		}
 
-		setTimePoint("RsOprfSender::eval-hash");
+		if (mVoleSender.mMalType == oc::SilentSecType::Malicious)
+			throw std::runtime_error("a malicious vole can not be split, see maxVoleParts(...). " LOCATION);
 
+		// part i is an independent vole of the correlations [n * i / numParts,
+		// n * (i+1) / numParts) with the same d. The receiver splits the same way.
+		prngs.reserve(numParts);
+		socks.reserve(numParts);
+		for (u64 i = 0; i < numParts; ++i)
+		{
+			auto size = n * (i + 1) / numParts - n * i / numParts;
+			parts.emplace_back(new VoleSender);
+			parts[i]->mMultType = mVoleSender.mMultType;
+			parts[i]->mMalType = mVoleSender.mMalType;
+			if (reduceRounds)
+				parts[i]->configure(size, oc::SilentBaseType::Base);
+
+			prngs.emplace_back(prng.get<block>());
+			socks.push_back(chl.fork());
+			protos.push_back(parts[i]->silentSendInplace(mD, size, prngs[i], socks[i]));
+		}
+
+		co_await(runParallel(std::move(protos), mExecutor));
+
+		// each part is freed once copied, see OprfServer::sessionMemory(...).
+		mVoleBacking.reset(n);
+		for (u64 i = 0; i < numParts; ++i)
+		{
+			auto begin = n * i / numParts;
+			auto size = n * (i + 1) / numParts - begin;
+			std::memcpy(mVoleBacking.data() + begin, parts[i]->mB.data(), size * sizeof(block));
+			parts[i].reset();
+		}
+		mB = span<block>(mVoleBacking.data(), n);
 	}
 
-	Proto RsOprfSender::genVole(PRNG& prng, Socket& chl, bool reduceRounds)
+	Proto RsOprfSender::offline(u64 n, PRNG& prng, Socket& chl, const std::string& path, bool reducedRounds)
 	{
-		if (reduceRounds)
-			mVoleSender.configure(mPaxos.size(), oc::SilentBaseType::Base);
+		auto voleId = block{};
+
+		setTimePoint("RsOprfSender::offline-begin");
+
+		// the vole has the size of the paxos that send(n, ...) will use.
+		mPaxos.init(n, mBinSize, mWeight, mSsp, PaxosParam::GF128, oc::ZeroBlock);
+		mD = prng.get();
+
+		if (mMalicious)
+			mVoleSender.mMalType = oc::SilentSecType::Malicious;
+		if (mTimer)
+			mVoleSender.setTimer(*mTimer);
+
+		// the receiver picks the id that both files are stored with.
+		co_await(chl.recv(voleId));
+		if (voleId == oc::ZeroBlock)
+			throw RTE_LOC;
+
+		co_await(genVole(prng, chl, reducedRounds));
+		setTimePoint("RsOprfSender::offline-vole");
 
-		return mVoleSender.silentSendInplace(mD, mPaxos.size(), prng, chl);
+		writeSenderVole(path, voleId, mD, mB.subspan(0, mPaxos.size()), mMalicious);
+		setTimePoint("RsOprfSender::offline-write");
+	}
+
+	void RsOprfSender::loadVole(const std::string& path)
+	{
+		mStoredVole.load(path);
+		if (mStoredVole.mRole != VoleFileHeader::SenderRole)
+		{
+			mStoredVole.clear();
+			throw std::runtime_error(path + " is not a vole of the sender. " LOCATION);
+		}
 	}
 
 	struct UninitVec : span<block>
 	{
-		std::unique_ptr<block[]> ptr;
+		AllocBuffer<block> ptr;
 
 		void resize(u64 s)
 		{
-			ptr.reset(new block[s]);
+			ptr.reset(s);
 			static_cast<span<block>&>(*this) = span<block>(ptr.get(), s);
 		}
 	};
@@ -271,7 +594,7 @@ namespace volePSI
 		auto ws = block{};
 		auto Hws = std::array<u8, 32> {};
 		auto paxos = Baxos{};
-		auto hPtr = std::unique_ptr<block[]>{};
+		auto hPtr = AllocBuffer<block>{};
 		auto h = span<block>{};
 		auto p = UninitVec{};
 		auto subP = span<block>{};
@@ -279,19 +602,49 @@ namespace volePSI
 		auto a = span<block>{};
 		auto c = span<block>{};
 		auto fu = macoro::eager_task<void>{};
+		auto sendFu = macoro::eager_task<void>{};
 		auto ii = u64{ 0 };
+		auto chunkSize = u64{ 0 };
+		auto voleParts = u64{ 1 };
+		auto maxParts = u64{ 1 };
+		auto solveThreads = u64{ 0 };
+		auto voleId = block{};
+		auto peerVoleId = block{};
 		auto fork = Socket{};
+		auto vole = StoredVole{};
+		auto solved = SolvedBins{};
+		auto solveTask = TaskGroup{};
 
 		setTimePoint("RsOprfReceiver::receive-begin");
 
 		if (values.size() != outputs.size())
 			throw RTE_LOC;
+		if (mChunkSize == 0)
+			throw RTE_LOC;
 
 		hashingSeed = prng.get(), wr = prng.get();
 		paxos.mDebug = mDebug;
-		paxos.init(values.size(), mBinSize, 3, mSsp, PaxosParam::GF128, hashingSeed);
+		paxos.init(values.size(), mBinSize, mWeight, mSsp, PaxosParam::GF128, hashingSeed);
+
+		if (mStoredVole.loaded() && (
+			mStoredVole.mRole != VoleFileHeader::ReceiverRole ||
+			mStoredVole.mMalicious != mMalicious ||
+			mStoredVole.mSize < paxos.size()))
+			throw std::runtime_error("the stored vole does not fit this receive. " LOCATION);
 
+		// the chunks hold whole bins so that each can be sent once its
+		// bins are solved.
+		paxos.mSolvedRangeBins = std::max<u64>(1, mChunkSize / paxos.mPaxosParam.size());
+		chunkSize = paxos.mSolvedRangeBins * paxos.mPaxosParam.size();
+		solved.init(paxos.mNumBins, paxos.mSolvedRangeBins);
+		paxos.mOnBinsSolved = [&](u64 binBegin, u64) { solved.set(binBegin); };
+
+		numThreads = std::max<u64>(1, numThreads);
+
+		// see RsOprfSender::send(...), the stored voles must match.
+		voleId = mStoredVole.loaded() ? mStoredVole.mVoleId : oc::ZeroBlock;
 		co_await(chl.send(std::move(hashingSeed)));
+		co_await(chl.send(block(voleId)));
 
 		if (mMalicious)
 		{
@@ -299,19 +652,45 @@ namespace volePSI
 			co_await(chl.recv(Hws));
 		}
 
+		co_await(chl.recv(peerVoleId));
+		if (peerVoleId != voleId)
+			throw std::runtime_error("the sender does not use the same stored vole. " LOCATION);
+
+		// the vole runs at the same time as the solve. Large voles are
+		// split into parts that run on half of the threads, the solve
+		// gets the other half. The sender caps the parts, see 
+		// maxVoleParts(...).
+		co_await(chl.recv(maxParts));
+		solveThreads = numThreads;
+		if (mStoredVole.loaded() == false)
+		{
+			voleParts = std::min<u64>(numThreads / 2, maxVoleParts(paxos.size(), maxParts, mMalicious));
+			voleParts = std::max<u64>(1, voleParts);
+			solveThreads = std::max<u64>(1, numThreads - voleParts);
+		}
+
+		co_await(chl.send(u64(chunkSize)));
+		co_await(chl.send(u64(voleParts)));
+
 		if (mTimer)
 			mVoleRecver.setTimer(*mTimer);
 
-		fork = chl.fork();
-		fu = genVole(paxos.size(), prng, fork, reducedRounds)
-			| macoro::make_eager();
+		if (mStoredVole.loaded() == false)
+		{
+			fork = chl.fork();
+			fu = genVole(paxos.size(), prng, fork, reducedRounds, voleParts)
+				| macoro::make_eager();
+		}
 
 
 
-		hPtr.reset(new block[values.size()]);
+		hPtr.reset(values.size());
 		h = span<block>(hPtr.get(), values.size());
 
-		oc::mAesFixedKey.hashBlocks(values, h);
+		// the vole keeps running in fu while the values are hashed.
+		parallelRanges(values.size(), numThreads, [&](u64 begin, u64 end) {
+			oc::mAesFixedKey.hashBlocks(values.subspan(begin, end - begin), h.subspan(begin, end - begin));
+		});
 		setTimePoint("RsOprfReceiver::receive-hash");
 
 		//auto pPtr = std::make_shared<std::vector<block>>(paxos.size());
@@ -321,13 +700,37 @@ namespace volePSI
 
 		setTimePoint("RsOprfReceiver::receive-alloc");
 
-		paxos.solve<block>(values, h, p, nullptr, numThreads);
-		setTimePoint("RsOprfReceiver::receive-solve");
-		co_await(fu);
+		// solve on another thread so that the vole and the sending of 
+		// the solved chunks overlap with the solving of the rest.
+		solveTask = threadPool()->spawn(1, [&](u64)
+		{
+			try
+			{
+				paxos.solve<block>(values, h, p, nullptr, solveThreads);
+			}
+			catch (...)
+			{
+				solved.fail(std::current_exception());
+				return;
+			}
+			solved.finish();
+		});
 
 		// a + b  = c * d
-		a = mVoleRecver.mA;
-		c = mVoleRecver.mC;
+		if (mStoredVole.loaded())
+		{
+			// the stored vole is only used once.
+			vole = std::move(mStoredVole);
+			mStoredVole.clear();
+			a = span<block>(vole.mA.data(), paxos.size());
+			c = span<block>(vole.mC.data(), paxos.size());
+		}
+		else
+		{
+			co_await(fu);
+			a = mA;
+			c = mC;
+		}
 
 		setTimePoint("RsOprfReceiver::receive-vole");
 
@@ -337,88 +740,33 @@ namespace volePSI
 			co_await(chl.send(std::move(wr)));
 		}
 
-
-		//if (numThreads > 1)
-		//    thrd.join();
-		if (0)
-		{
-			{
-				auto main = (p.size() / 8) * 8;
-				block* __restrict pp = p.data();
-				block* __restrict cc = c.data();
-				for (u64 i = 0; i < main; i += 8)
-				{
-					pp[0] = pp[0] ^ cc[0];
-					pp[1] = pp[1] ^ cc[1];
-					pp[2] = pp[2] ^ cc[2];
-					pp[3] = pp[3] ^ cc[3];
-					pp[4] = pp[4] ^ cc[4];
-					pp[5] = pp[5] ^ cc[5];
-					pp[6] = pp[6] ^ cc[6];
-					pp[7] = pp[7] ^ cc[7];
-
-					pp += 8;
-					cc += 8;
-				}
-				for (u64 i = main; i < p.size(); ++i)
-					p[i] = p[i] ^ c[i];
-			}
-
-			setTimePoint("RsOprfReceiver::receive-xor");
-
-			// send c ^ p
-			co_await(chl.send(std::move(p)));
-		}
-		else
+		// send c ^ p one chunk at a time. While a chunk is being sent, 
+		// the next one is solved and xored.
+		for (ii = 0; ii * chunkSize < p.size(); ++ii)
 		{
-			ii = 0;
-
-			while (c.size())
-			{
+			subP = p.subspan(ii * chunkSize, std::min<u64>(chunkSize, p.size() - ii * chunkSize));
+			subC = c.subspan(ii * chunkSize, subP.size());
 
-				subP = p.subspan(0, std::min<u64>(p.size(), 1 << 28));
-				subC = c.subspan(0, subP.size());
+			co_await(waitSolved(solved, ii, mExecutor));
+			setTimePoint("RsOprfReceiver::receive-solve-" + std::to_string(ii));
 
-				if (p.size() != subP.size())
-					static_cast<span<block>&>(p) = p.subspan(subP.size());
-				c = c.subspan(subP.size());
-
-				{
-
-					auto main = (subP.size() / 8) * 8;
-					block* __restrict pp = subP.data();
-					block* __restrict cc = subC.data();
-					for (u64 i = 0; i < main; i += 8)
-					{
-						pp[0] = pp[0] ^ cc[0];
-						pp[1] = pp[1] ^ cc[1];
-						pp[2] = pp[2] ^ cc[2];
-						pp[3] = pp[3] ^ cc[3];
-						pp[4] = pp[4] ^ cc[4];
-						pp[5] = pp[5] ^ cc[5];
-						pp[6] = pp[6] ^ cc[6];
-						pp[7] = pp[7] ^ cc[7];
-
-						pp += 8;
-						cc += 8;
-					}
-					for (u64 i = main; i < p.size(); ++i, ++pp, ++cc)
-						*pp = *pp ^ *cc;
-				}
+			parallelRanges(subP.size(), numThreads, [&](u64 begin, u64 end) {
+				xorInplace(subP.subspan(begin, end - begin), subC.subspan(begin, end - begin));
+			});
+			setTimePoint("RsOprfReceiver::receive-xor-" + std::to_string(ii));
 
-				setTimePoint("RsOprfReceiver::receive-xor");
-
-				if (p.size() != subP.size())
-					co_await(chl.send(std::move(subP)));
-				else
-					co_await(chl.send(std::move(p)));
+			if (ii)
+				co_await(sendFu);
+			sendFu = sendChunk(chl, subP) | macoro::make_eager();
+		}
 
-				setTimePoint("RsOprfReceiver::receive-send");
+		if (ii)
+			co_await(sendFu);
 
-				++ii;
-			}
-
-		}
+		// solve(...) has returned, the task only has to exit.
+		co_await(waitSolved(solved, solved.finishedIdx(), mExecutor));
+		solveTask.wait();
+		setTimePoint("RsOprfReceiver::receive-send");
 
 		paxos.decode<block>(values, outputs, a, numThreads);
 
@@ -438,62 +786,150 @@ namespace volePSI
 
 				auto w = ws ^ wr;
 
-				// todo, parallelize this.
-
 				// compute davies-meyer F
 				//    F(x) = H( Decode(x, a) + w, x)
 				// where 
 				//    H(u,v) = AES_u(v) ^ v
-
-				oc::MultiKeyAES<8> hasher;
-				auto main = outputs.size() / 8 * 8;
-				auto o = outputs.data();
-				auto v = values.data();
-				for (u64 i = 0; i < main; i += 8)
+				parallelRanges(outputs.size(), numThreads, [&](u64 begin, u64 end)
 				{
-					o[0] = o[0] ^ w;
-					o[1] = o[1] ^ w;
-					o[2] = o[2] ^ w;
-					o[3] = o[3] ^ w;
-					o[4] = o[4] ^ w;
-					o[5] = o[5] ^ w;
-					o[6] = o[6] ^ w;
-					o[7] = o[7] ^ w;
-
-					// o = H(o, v)
-					hasher.setKeys({ o, 8 });
-					hasher.hashNBlocks(v, o);
-
-					o += 8;
-					v += 8;
-				}
+					oc::MultiKeyAES<8> hasher;
+					auto main = begin + (end - begin) / 8 * 8;
+					auto o = outputs.data() + begin;
+					auto v = values.data() + begin;
+					for (u64 i = begin; i < main; i += 8)
+					{
+						o[0] = o[0] ^ w;
+						o[1] = o[1] ^ w;
+						o[2] = o[2] ^ w;
+						o[3] = o[3] ^ w;
+						o[4] = o[4] ^ w;
+						o[5] = o[5] ^ w;
+						o[6] = o[6] ^ w;
+						o[7] = o[7] ^ w;
+
+						// o = H(o, v)
+						hasher.setKeys({ o, 8 });
+						hasher.hashNBlocks(v, o);
+
+						o += 8;
+						v += 8;
+					}
 
-				for (u64 i = main; i < outputs.size(); ++i)
-				{
-					outputs[i] = outputs[i] ^ w;
-					outputs[i] = oc::AES(outputs[i]).hashBlock(values[i]);
-				}
+					for (u64 i = main; i < end; ++i)
+					{
+						outputs[i] = outputs[i] ^ w;
+						outputs[i] = oc::AES(outputs[i]).hashBlock(values[i]);
+					}
+				});
 			}
 		}
 		else
 		{
-			// todo, parallelize this.
-
 			// compute davies-meyer-Oseas F
 			//      F(x) = H(Decode(x, a))
 			// where
 			//      H(u) = AES_fixed(u) ^ u
-			oc::mAesFixedKey.hashBlocks(outputs, outputs);
+			parallelRanges(outputs.size(), numThreads, [&](u64 begin, u64 end) {
+				auto o = outputs.subspan(begin, end - begin);
+				oc::mAesFixedKey.hashBlocks(o, o);
+			});
 		}
 
 		setTimePoint("RsOprfReceiver::receive-hash");
 	}
 
-	Proto RsOprfReceiver::genVole(u64 n, PRNG& prng, Socket& chl, bool reducedRounds)
+	Proto RsOprfReceiver::genVole(u64 n, PRNG& prng, Socket& chl, bool reducedRounds, u64 numParts)
 	{
-		if (reducedRounds)
-			mVoleRecver.configure(n, oc::SilentBaseType::Base);
-		return mVoleRecver.silentReceiveInplace(n, prng, chl);
+		using VoleRecver = oc::SilentVoleReceiver<block, block, oc::CoeffCtxGF128>;
+		auto parts = std::vector<std::unique_ptr<VoleRecver>>{};
+		auto prngs = std::vector<PRNG>{};
+		auto socks = std::vector<Socket>{};
+		auto protos = std::vector<Proto>{};
+
+		if (numParts <= 1)
+		{
+			if (reducedRounds)
+				mVoleRecver.configure(n, oc::SilentBaseType::Base);
+
+			co_await(mVoleRecver.silentReceiveInplace(n, prng, chl));
+			mA = mVoleRecver.mA;
+			mC = mVoleRecver.mC;
+			co_return;
+		}
+
+		if (mVoleRecver.mMalType == oc::SilentSecType::Malicious)
+			throw std::runtime_error("a malicious vole can not be split, see maxVoleParts(...). " LOCATION);
+
+		// see RsOprfSender::genVole(...).
+		prngs.reserve(numParts);
+		socks.reserve(numParts);
+		for (u64 i = 0; i < numParts; ++i)
+		{
+			auto size = n * (i + 1) / numParts - n * i / numParts;
+			parts.emplace_back(new VoleRecver);
+			parts[i]->mMultType = mVoleRecver.mMultType;
+			parts[i]->mMalType = mVoleRecver.mMalType;
+			if (reducedRounds)
+				parts[i]->configure(size, oc::SilentBaseType::Base);
+
+			prngs.emplace_back(prng.get<block>());
+			socks.push_back(chl.fork());
+			protos.push_back(parts[i]->silentReceiveInplace(size, prngs[i], socks[i]));
+		}
+
+		co_await(runParallel(std::move(protos), mExecutor));
+
+		mVoleBacking.reset(2 * n);
+		mA = span<block>(mVoleBacking.data(), n);
+		mC = span<block>(mVoleBacking.data() + n, n);
+		for (u64 i = 0; i < numParts; ++i)
+		{
+			auto begin = n * i / numParts;
+			auto size = n * (i + 1) / numParts - begin;
+			std::memcpy(mA.data() + begin, parts[i]->mA.data(), size * sizeof(block));
+			std::memcpy(mC.data() + begin, parts[i]->mC.data(), size * sizeof(block));
+			parts[i].reset();
+		}
+	}
+
+	Proto RsOprfReceiver::offline(u64 n, PRNG& prng, Socket& chl, const std::string& path, bool reducedRounds)
+	{
+		auto paxos = Baxos{};
+		auto voleId = block{};
+
+		setTimePoint("RsOprfReceiver::offline-begin");
+
+		// the vole has the size of the paxos that receive(...) will use.
+		paxos.init(n, mBinSize, mWeight, mSsp, PaxosParam::GF128, oc::ZeroBlock);
+
+		if (mMalicious)
+			mVoleRecver.mMalType = oc::SilentSecType::Malicious;
+		if (mTimer)
+			mVoleRecver.setTimer(*mTimer);
+
+		// the id that send(...) and receive(...) compare, never zero.
+		do voleId = prng.get<block>();
+		while (voleId == oc::ZeroBlock);
+		co_await(chl.send(block(voleId)));
+
+		co_await(genVole(paxos.size(), prng, chl, reducedRounds));
+		setTimePoint("RsOprfReceiver::offline-vole");
+
+		writeReceiverVole(path, voleId,
+			mA.subspan(0, paxos.size()),
+			mC.subspan(0, paxos.size()),
+			mMalicious);
+		setTimePoint("RsOprfReceiver::offline-write");
+	}
+
+	void RsOprfReceiver::loadVole(const std::string& path)
+	{
+		mStoredVole.load(path);
+		if (mStoredVole.mRole != VoleFileHeader::ReceiverRole)
+		{
+			mStoredVole.clear();
+			throw std::runtime_error(path + " is not a vole of the receiver. " LOCATION);
+		}
 	}
 
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include "Defines.h"
 #include "Paxos.h"
+#include "VoleStore.h"
+#include <macoro/thread_pool.h>
 #include "libOTe/Vole/Silent/SilentVoleSender.h"
 #include "libOTe/Vole/Silent/SilentVoleReceiver.h"
 
@@ -17,9 +19,20 @@ namespace volePSI
         bool mMalicious = false;
         block mW;
         u64 mBinSize = 1 << 14;
+        u64 mWeight = 3;
         u64 mSsp = 40;
         bool mDebug = false;
 
+        // the most parts that send(...) lets the receiver split the vole
+        // into, see genVole(...). Each part is at least 2^20 correlations
+        // and a malicious vole is never split.
+        u64 mMaxVoleParts = 16;
+
+        // the executor that the parts of a split vole run on, and that
+        // send(...) continues on once they are done. Without one they run
+        // on threads that are shared by all oprfs of the process.
+        macoro::thread_pool* mExecutor = nullptr;
+
         void setMultType(oc::MultType type) { mVoleSender.mMultType = type; };
 
         Proto send(u64 n, PRNG& prng, Socket& chl, u64 mNumThreads = 0, bool reducedRounds = false);
@@ -31,7 +44,27 @@ namespace volePSI
         void eval(span<const block> val, span<block> output, u64 mNumThreads = 0);
 
 
-        Proto genVole(PRNG& prng, Socket& chl, bool reducedRounds);
+        // generate the vole of size mPaxos.size() with d = mD and set mB.
+        // With numParts > 1 the vole is split into that many independent
+        // voles that run on separate threads. Only for semi-honest voles,
+        // nothing binds the parts to the same d.
+        Proto genVole(PRNG& prng, Socket& chl, bool reducedRounds, u64 numParts = 1);
+
+        // the vole that the next send(...) uses instead of generating one, see loadVole(...).
+        StoredVole mStoredVole;
+
+        // holds mB once a stored vole has been used or the vole was split.
+        AllocBuffer<block> mVoleBacking;
+
+        // generate the vole for a later send(n, ...) and write it to path,
+        // while the receiver calls RsOprfReceiver::offline(n, ...). path 
+        // must not exist.
+        Proto offline(u64 n, PRNG& prng, Socket& chl, const std::string& path, bool reducedRounds = false);
+
+        // have the next send(...) use the vole that offline(...) wrote to
+        // path. The file is removed. The receiver must also load the vole
+        // it generated at the same time, send(...) throws otherwise.
+        void loadVole(const std::string& path);
     };
 
 
@@ -43,15 +76,47 @@ namespace volePSI
         bool mMalicious = false;
         oc::SilentVoleReceiver<block, block, oc::CoeffCtxGF128> mVoleRecver;
         u64 mBinSize = 1 << 14;
+        u64 mWeight = 3;
         u64 mSsp = 40;
         bool mDebug = false;
 
+        // the number of blocks of the paxos that are sent per message, 
+        // rounded down to whole bins. A chunk is sent as soon as its bins
+        // are solved, while the other bins are still being solved.
+        u64 mChunkSize = 1 << 20;
+
+        // the executor that receive(...) runs on, if any. While it waits 
+        // for the solve, the coroutine is suspended and resumed on it. 
+        // Without one the waiting thread blocks. The parts of a split
+        // vole also run on it, see RsOprfSender::mExecutor.
+        macoro::thread_pool* mExecutor = nullptr;
+
         void setMultType(oc::MultType type) { mVoleRecver.mMultType = type; };
 
         Proto receive(span<const block> values, span<block> outputs, PRNG& prng, Socket& chl, u64 mNumThreads = 0, bool reducedRounds = false);
 
 
-        Proto genVole(u64 n, PRNG& prng, Socket& chl, bool reducedRounds);
+        // generate a vole of size n and set mA, mC. numParts must be the
+        // same as the sender's, see RsOprfSender::genVole(...).
+        Proto genVole(u64 n, PRNG& prng, Socket& chl, bool reducedRounds, u64 numParts = 1);
+
+        // the vole of the last genVole(...), a + b = c * d.
+        span<block> mA, mC;
+
+        // holds mA and mC when the vole was split.
+        AllocBuffer<block> mVoleBacking;
+
+        // the vole that the next receive(...) uses instead of generating one, see loadVole(...).
+        StoredVole mStoredVole;
+
+        // generate the vole for a later receive(...) of n values and write
+        // it to path, while the sender calls RsOprfSender::offline(n, ...).
+        // path must not exist.
+        Proto offline(u64 n, PRNG& prng, Socket& chl, const std::string& path, bool reducedRounds = false);
 
+        // have the next receive(...) use the vole that offline(...) wrote 
+        // to path. The file is removed. The sender must also load the vole
+        // it generated at the same time, receive(...) throws otherwise.
+        void loadVole(const std::string& path);
     };
 }
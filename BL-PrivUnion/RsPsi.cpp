@@ -107,16 +107,22 @@ namespace volePSI
 
 		struct MultiThread
 		{
-			std::promise<void> prom;
-			std::shared_future<void> fu;
-			std::vector<std::thread> thrds;
+			MultiThread(u64 n)
+				: numThreads(n)
+				, hashingDone(n)
+				, recvDone(n + 1)
+			{}
+
+			TaskGroup thrds;
 			std::function<void(u64)>routine;
-			std::atomic<u64> numDone;
-			std::promise<void> hashingDoneProm;
-			std::shared_future<void> hashingDoneFu;
 			std::mutex mMergeMtx;
 
 			u64 numThreads;
+
+			// the threads wait on each other once they have hashed their 
+			// items and, with the protocol, once theirHashes is received.
+			ThreadBarrier hashingDone, recvDone;
+
 			u64 binSize;
 			libdivide::libdivide_u32_t divider;
 		};
@@ -130,6 +136,7 @@ namespace volePSI
 		auto hh = std::array<std::pair<block, u64>, 128> {};
 		auto mt = std::unique_ptr<MultiThread>{};
 		auto mask = block{};
+		auto ex = std::exception_ptr{};
 
 		setTimePoint("RsPsiReceiver::run-begin");
 		mIntersection.clear();
@@ -221,16 +228,10 @@ namespace volePSI
 		}
 		else
 		{
-			mt.reset(new MultiThread);
-
-			mt->fu = mt->prom.get_future().share();
+			mt.reset(new MultiThread(std::max<u64>(1, mNumThreads)));
 
 			setTimePoint("RsPsiReceiver::run-reserve");
 
-			mt->numDone = 0;
-			mt->hashingDoneFu = mt->hashingDoneProm.get_future().share();
-
-			mt->numThreads = std::max<u64>(1, mNumThreads);
 			mt->binSize = Baxos::getBinSize(mNumThreads, mRecverSize, mSsp);
 			mt->divider = libdivide::libdivide_u32_gen(mt->numThreads);
 
@@ -266,15 +267,12 @@ namespace volePSI
 						map.insert(hh.begin(), hh.begin() + j);
 					}
 
-					if (++mt->numDone == mt->numThreads)
-						mt->hashingDoneProm.set_value();
-					else
-						mt->hashingDoneFu.get();
+					mt->hashingDone.wait();
 
 					if (!thrdIdx)
 						setTimePoint("RsPsiReceiver::run-insert_par");
 
-					mt->fu.get();
+					mt->recvDone.wait();
 					if (!thrdIdx)
 						setTimePoint("RsPsiReceiver::run-recv_par");
 
@@ -315,14 +313,40 @@ namespace volePSI
 				};
 
 
-			mt->thrds.resize(mt->numThreads);
-			for (i = 0; i < mt->thrds.size(); ++i)
-				mt->thrds[i] = std::thread(mt->routine, i);
-			co_await(chl.recv(theirHashes));
-			mt->prom.set_value();
+			// a thread that fails releases the others from the barriers.
+			mt->thrds = threadPool()->spawn(mt->numThreads, [t = mt.get()](u64 thrdIdx)
+			{
+				try { t->routine(thrdIdx); }
+				catch (...)
+				{
+					t->hashingDone.abort(std::current_exception());
+					t->recvDone.abort(std::current_exception());
+					throw;
+				}
+			});
+
+			try
+			{
+				co_await(chl.recv(theirHashes));
+			}
+			catch (...)
+			{
+				ex = std::current_exception();
+			}
+
+			if (ex)
+			{
+				mt->recvDone.abort(ex);
+				try { mt->thrds.wait(); }
+				catch (...) {}
+				std::rethrow_exception(ex);
+			}
 
-			for (i = 0; i < mt->thrds.size(); ++i)
-				mt->thrds[i].join();
+			// only throws if a thread failed, thrds.wait() then rethrows
+			// its exception. The threads must finish before mt is freed.
+			try { mt->recvDone.wait(); }
+			catch (...) {}
+			mt->thrds.wait();
 
 			setTimePoint("RsPsiReceiver::run-done");
 
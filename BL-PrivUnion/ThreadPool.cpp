@@ -0,0 +1,141 @@
+#include "ThreadPool.h"
+
+namespace volePSI
+{
+	struct ThreadPool::Worker
+	{
+		std::thread mThread;
+		std::mutex mMtx;
+		std::condition_variable mCv;
+		std::function<void()> mJob;
+		std::atomic<bool> mHasJob{ false };
+		bool mStop = false;
+	};
+
+	TaskGroup::~TaskGroup()
+	{
+		if (mState)
+		{
+			try { wait(); }
+			catch (...) {}
+		}
+	}
+
+	void TaskGroup::wait()
+	{
+		if (!mState)
+			return;
+
+		auto done = [&] { return mState->mRemaining.load(std::memory_order_acquire) == 0; };
+		if (!spinWait(done))
+		{
+			std::unique_lock<std::mutex> lock(mState->mMtx);
+			mState->mCv.wait(lock, done);
+		}
+
+		auto ex = std::move(mState->mException);
+		mState = {};
+		if (ex)
+			std::rethrow_exception(ex);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		for (auto& w : mWorkers)
+		{
+			{
+				std::lock_guard<std::mutex> lock(w->mMtx);
+				w->mStop = true;
+			}
+			w->mCv.notify_one();
+		}
+
+		for (auto& w : mWorkers)
+			w->mThread.join();
+	}
+
+	u64 ThreadPool::size() const
+	{
+		std::lock_guard<std::mutex> lock(mMtx);
+		return mWorkers.size();
+	}
+
+	void ThreadPool::start(const std::shared_ptr<TaskGroup::State>& state, u64 i)
+	{
+		Worker* w;
+		{
+			std::lock_guard<std::mutex> lock(mMtx);
+			if (mIdle.size())
+			{
+				w = mIdle.back();
+				mIdle.pop_back();
+			}
+			else
+			{
+				mWorkers.emplace_back(new Worker);
+				w = mWorkers.back().get();
+				w->mThread = std::thread([this, w] { workerMain(w); });
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(w->mMtx);
+			w->mJob = [this, w, state, i]
+			{
+				try { state->mRoutine(i); }
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(state->mMtx);
+					if (!state->mException)
+						state->mException = std::current_exception();
+				}
+
+				// the worker is idle before the group completes so that
+				// the next spawn(...) of the waiter reuses it rather than
+				// creating a thread. A new job is only picked up once 
+				// this one has returned.
+				{
+					std::lock_guard<std::mutex> lock(mMtx);
+					mIdle.push_back(w);
+				}
+
+				if (state->mRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					std::lock_guard<std::mutex> lock(state->mMtx);
+					state->mCv.notify_all();
+				}
+			};
+			w->mHasJob.store(true, std::memory_order_release);
+		}
+		w->mCv.notify_one();
+	}
+
+	void ThreadPool::workerMain(Worker* w)
+	{
+		auto hasJob = [&] { return w->mHasJob.load(std::memory_order_acquire); };
+		while (true)
+		{
+			std::function<void()> job;
+			spinWait(hasJob);
+			{
+				std::unique_lock<std::mutex> lock(w->mMtx);
+				w->mCv.wait(lock, [&] { return hasJob() || w->mStop; });
+				if (!hasJob())
+					return;
+
+				job = std::move(w->mJob);
+				w->mJob = {};
+				w->mHasJob.store(false, std::memory_order_relaxed);
+			}
+
+			job();
+		}
+	}
+
+	ThreadPool*& threadPool()
+	{
+		// never destroyed, detached sessions may still use it at exit.
+		static ThreadPool* pool = new ThreadPool;
+		return pool;
+	}
+}
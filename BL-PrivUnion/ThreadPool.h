@@ -0,0 +1,225 @@
+#pragma once
+#include "Defines.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace volePSI
+{
+	// the number of times spinWait(...) polls before giving up. 
+	// Spinning only helps if other threads can run at the same time.
+	inline u64 spinCount()
+	{
+		static const u64 count = std::thread::hardware_concurrency() > 1 ? 1 << 12 : 0;
+		return count;
+	}
+
+	// poll pred for a short while. Returns true if pred() became true.
+	template<typename Pred>
+	bool spinWait(Pred&& pred)
+	{
+		for (u64 i = 0, n = spinCount(); i < n; ++i)
+		{
+			if (pred())
+				return true;
+#if defined(__x86_64__) || defined(_M_X64)
+			_mm_pause();
+#else
+			std::this_thread::yield();
+#endif
+		}
+		return pred();
+	}
+
+	// A reusable barrier for a fixed number of threads. Waiting threads
+	// spin for a short while before they block, since the other threads
+	// usually arrive soon. A thread that fails and will not arrive calls 
+	// abort(...), the waiting threads then rethrow its exception.
+	struct ThreadBarrier
+	{
+		std::mutex mMtx;
+		std::condition_variable mCv;
+		u64 mNumThreads;
+		std::atomic<u64> mCount{ 0 }, mGeneration{ 0 };
+		std::atomic<bool> mAborted{ false };
+		std::exception_ptr mException;
+
+		ThreadBarrier(u64 numThreads)
+			: mNumThreads(numThreads)
+		{}
+
+		// block until all mNumThreads threads have called wait(). Throws
+		// the exception given to abort(...) if the barrier was aborted.
+		void wait()
+		{
+			throwIfAborted();
+			auto gen = mGeneration.load(std::memory_order_acquire);
+			if (mCount.fetch_add(1, std::memory_order_acq_rel) + 1 == mNumThreads)
+			{
+				mCount.store(0, std::memory_order_relaxed);
+				{
+					std::lock_guard<std::mutex> lock(mMtx);
+					mGeneration.fetch_add(1, std::memory_order_release);
+				}
+				mCv.notify_all();
+				return;
+			}
+
+			// with more threads than cores, the last thread may 
+			// need this core to arrive.
+			auto released = [&] {
+				return mGeneration.load(std::memory_order_acquire) != gen ||
+					mAborted.load(std::memory_order_acquire);
+			};
+			auto spin = mNumThreads <= std::thread::hardware_concurrency();
+			if (!spin || !spinWait(released))
+			{
+				std::unique_lock<std::mutex> lock(mMtx);
+				mCv.wait(lock, released);
+			}
+
+			throwIfAborted();
+		}
+
+		// release the current and all later waiters, they throw ex. The
+		// barrier can not be used after that. The first exception is kept.
+		void abort(std::exception_ptr ex)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mMtx);
+				if (mAborted.load(std::memory_order_relaxed))
+					return;
+				mException = ex;
+				mAborted.store(true, std::memory_order_release);
+			}
+			mCv.notify_all();
+		}
+
+		// returns routine wrapped so that a thread that throws aborts 
+		// this barrier with its exception. routine must outlive the result.
+		template<typename Routine>
+		auto abortOnThrow(Routine& routine)
+		{
+			return [this, &routine](u64 thrdIdx)
+			{
+				try { routine(thrdIdx); }
+				catch (...)
+				{
+					abort(std::current_exception());
+					throw;
+				}
+			};
+		}
+
+	private:
+		void throwIfAborted()
+		{
+			if (mAborted.load(std::memory_order_acquire))
+				std::rethrow_exception(mException);
+		}
+	};
+
+	// The tasks started by ThreadPool::spawn(...). wait() blocks until
+	// all of them have finished and rethrows the first exception.
+	class TaskGroup
+	{
+	public:
+		TaskGroup() = default;
+		TaskGroup(TaskGroup&&) = default;
+		TaskGroup& operator=(TaskGroup&&) = default;
+
+		// waits for the tasks.
+		~TaskGroup();
+
+		// block until all tasks of the group have finished.
+		void wait();
+
+	private:
+		friend class ThreadPool;
+
+		struct State
+		{
+			std::function<void(u64)> mRoutine;
+			std::atomic<u64> mRemaining{ 0 };
+			std::mutex mMtx;
+			std::condition_variable mCv;
+			std::exception_ptr mException;
+		};
+
+		std::shared_ptr<State> mState;
+	};
+
+	// A set of threads that are kept alive between calls. A group of n
+	// tasks is always given n idle threads (more are created if needed)
+	// so that the tasks run at the same time and may wait on each other,
+	// e.g. with a ThreadBarrier. Idle threads spin for a short while
+	// before they block.
+	class ThreadPool
+	{
+	public:
+		ThreadPool() = default;
+		ThreadPool(const ThreadPool&) = delete;
+
+		// stops and joins the threads. Running groups must be waited on first.
+		~ThreadPool();
+
+		// start routine(i) for i in [0, n) on n pool threads.
+		template<typename Routine>
+		TaskGroup spawn(u64 n, Routine&& routine)
+		{
+			TaskGroup group;
+			group.mState = std::make_shared<TaskGroup::State>();
+			group.mState->mRoutine = std::forward<Routine>(routine);
+			group.mState->mRemaining = n;
+			for (u64 i = 0; i < n; ++i)
+				start(group.mState, i);
+			return group;
+		}
+
+		// call routine(thrdIdx) for thrdIdx in [0, numThreads) and wait
+		// for them to finish. The last one runs on the calling thread.
+		template<typename Routine>
+		void run(u64 numThreads, Routine&& routine)
+		{
+			numThreads = std::max<u64>(1, numThreads);
+			auto group = spawn(numThreads - 1, std::ref(routine));
+
+			std::exception_ptr ex;
+			try { routine(numThreads - 1); }
+			catch (...) { ex = std::current_exception(); }
+
+			group.wait();
+			if (ex)
+				std::rethrow_exception(ex);
+		}
+
+		// the number of threads that have been created.
+		u64 size() const;
+
+	private:
+		struct Worker;
+
+		mutable std::mutex mMtx;
+		std::vector<std::unique_ptr<Worker>> mWorkers;
+		std::vector<Worker*> mIdle;
+
+		// run task i of the group on an idle thread.
+		void start(const std::shared_ptr<TaskGroup::State>& state, u64 i);
+
+		void workerMain(Worker* w);
+	};
+
+	// the pool used by Paxos, Baxos and the PSI. Can be set to another
+	// pool, which must outlive its use.
+	ThreadPool*& threadPool();
+}
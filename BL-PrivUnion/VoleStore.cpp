@@ -0,0 +1,184 @@
+#include "VoleStore.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace volePSI
+{
+	void VoleFileHeader::validate() const
+	{
+		if (mMagic != Magic)
+			throw std::runtime_error("not a vole file. " LOCATION);
+		if (mVersion == 0 || mVersion > CurrentVersion)
+			throw std::runtime_error("unsupported vole file version " + std::to_string(mVersion) + ". " LOCATION);
+		if (mRole != SenderRole && mRole != ReceiverRole)
+			throw std::runtime_error("unknown vole file role. " LOCATION);
+		if (mMalicious > 1 || mSize == 0 || (mVoleId[0] == 0 && mVoleId[1] == 0))
+			throw std::runtime_error("inconsistent vole file header. " LOCATION);
+	}
+
+	namespace
+	{
+		// a file that only its owner can read. It is created by open(...),
+		// which fails if the file exists, rather than replacing a vole.
+		struct PrivateFile
+		{
+			int mFd = -1;
+
+			PrivateFile(const std::string& path)
+			{
+#ifdef _WIN32
+				mFd = _open(path.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+				mFd = ::open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, S_IRUSR | S_IWUSR);
+#endif
+				if (mFd < 0)
+					throw std::runtime_error("failed to create " + path + ", it may already exist. " LOCATION);
+			}
+
+			~PrivateFile() { close(); }
+
+			bool write(const void* data, u64 size)
+			{
+				auto iter = (const u8*)data;
+				while (size)
+				{
+					auto step = std::min<u64>(size, 1ull << 30);
+#ifdef _WIN32
+					auto n = _write(mFd, iter, static_cast<unsigned>(step));
+#else
+					auto n = ::write(mFd, iter, step);
+#endif
+					if (n <= 0)
+						return false;
+					iter += n;
+					size -= n;
+				}
+				return true;
+			}
+
+			bool close()
+			{
+				if (mFd < 0)
+					return true;
+#ifdef _WIN32
+				auto r = _close(mFd);
+#else
+				auto r = ::close(mFd);
+#endif
+				mFd = -1;
+				return r == 0;
+			}
+		};
+
+		void writeVole(const std::string& path, const VoleFileHeader& header, span<const block> u, span<const block> v)
+		{
+			PrivateFile out(path);
+			auto ok =
+				out.write(&header, sizeof(header)) &&
+				out.write(u.data(), u.size_bytes()) &&
+				out.write(v.data(), v.size_bytes());
+
+			if (!out.close() || !ok)
+			{
+				// do not leave a partial vole behind.
+				std::remove(path.c_str());
+				throw std::runtime_error("failed to write " + path + ". " LOCATION);
+			}
+		}
+
+		void readBlocks(std::ifstream& in, const std::string& path, AllocBuffer<block>& buff, u64 n)
+		{
+			buff.reset(n);
+			in.read((char*)buff.data(), n * sizeof(block));
+			if (!in)
+				throw std::runtime_error(path + " is too small for its vole. " LOCATION);
+		}
+	}
+
+	void writeSenderVole(const std::string& path, block voleId, block d, span<const block> b, bool malicious)
+	{
+		VoleFileHeader header;
+		header.mRole = VoleFileHeader::SenderRole;
+		header.mMalicious = malicious;
+		header.mSize = b.size();
+		std::memcpy(header.mDelta.data(), &d, sizeof(block));
+		std::memcpy(header.mVoleId.data(), &voleId, sizeof(block));
+		header.validate();
+
+		writeVole(path, header, b, {});
+	}
+
+	void writeReceiverVole(const std::string& path, block voleId, span<const block> a, span<const block> c, bool malicious)
+	{
+		if (a.size() != c.size())
+			throw RTE_LOC;
+
+		VoleFileHeader header;
+		header.mRole = VoleFileHeader::ReceiverRole;
+		header.mMalicious = malicious;
+		header.mSize = a.size();
+		std::memcpy(header.mVoleId.data(), &voleId, sizeof(block));
+		header.validate();
+
+		writeVole(path, header, a, c);
+	}
+
+	void StoredVole::load(const std::string& path)
+	{
+		clear();
+
+		{
+			std::ifstream in(path, std::ios::binary);
+			if (!in)
+				throw std::runtime_error("failed to open " + path + ". " LOCATION);
+
+			VoleFileHeader header;
+			in.read((char*)&header, sizeof(header));
+			if (!in)
+				throw std::runtime_error(path + " is too small to be a vole file. " LOCATION);
+			header.validate();
+
+			mRole = header.mRole;
+			mMalicious = header.mMalicious;
+			std::memcpy(&mVoleId, header.mVoleId.data(), sizeof(block));
+			if (mRole == VoleFileHeader::SenderRole)
+			{
+				std::memcpy(&mD, header.mDelta.data(), sizeof(block));
+				readBlocks(in, path, mB, header.mSize);
+			}
+			else
+			{
+				readBlocks(in, path, mA, header.mSize);
+				readBlocks(in, path, mC, header.mSize);
+			}
+			mSize = header.mSize;
+		}
+
+		if (std::remove(path.c_str()))
+		{
+			clear();
+			throw std::runtime_error("failed to remove " + path + ", its vole must not be used again. " LOCATION);
+		}
+	}
+
+	void StoredVole::clear()
+	{
+		mSize = 0;
+		mMalicious = false;
+		mVoleId = oc::ZeroBlock;
+		mD = oc::ZeroBlock;
+		mA.reset();
+		mB.reset();
+		mC.reset();
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "Defines.h"
+#include "Alloc.h"
+#include <array>
+#include <string>
+
+namespace volePSI
+{
+	// The header of a file of VOLE correlations a + b = c * d that were
+	// generated ahead of the protocol. The file of the sender is
+	//
+	//   [VoleFileHeader][b]
+	//
+	// with d in mDelta, and the file of the receiver is
+	//
+	//   [VoleFileHeader][a][c]
+	//
+	// where a, b and c are mSize blocks each. All integers are in the
+	// native byte order. The two files of an offline run share a random
+	// mVoleId, which the parties compare before they use the voles. The
+	// file is only readable by its owner.
+	struct VoleFileHeader
+	{
+		static constexpr std::array<char, 8> Magic{ 'v', 'p', 's', 'i', 'v', 'o', 'l', 'e' };
+		static constexpr u32 CurrentVersion = 1;
+
+		enum Role : u8
+		{
+			SenderRole,
+			ReceiverRole
+		};
+
+		std::array<char, 8> mMagic = Magic;
+		u32 mVersion = CurrentVersion;
+		Role mRole = SenderRole;
+
+		// 1 if the vole was generated with malicious security.
+		u8 mMalicious = 0;
+		u16 mReserved = 0;
+
+		// the number of correlations.
+		u64 mSize = 0;
+
+		// the sender's d, zero for the receiver.
+		std::array<u64, 2> mDelta{};
+
+		// the id that both files of an offline run share, never zero.
+		std::array<u64, 2> mVoleId{};
+
+		// throws if the header is not a supported vole file header.
+		void validate() const;
+	};
+
+	// The VOLE correlations of one party read from a vole file. A
+	// correlation must not be used twice, so the file is removed as
+	// it is loaded.
+	struct StoredVole
+	{
+		VoleFileHeader::Role mRole = VoleFileHeader::SenderRole;
+		bool mMalicious = false;
+		u64 mSize = 0;
+
+		// the id of the offline run, see VoleFileHeader::mVoleId.
+		block mVoleId = oc::ZeroBlock;
+
+		// the sender's d and b.
+		block mD = oc::ZeroBlock;
+		AllocBuffer<block> mB;
+
+		// the receiver's a and c.
+		AllocBuffer<block> mA, mC;
+
+		// true if a vole has been loaded and not yet used.
+		bool loaded() const { return mSize != 0; }
+
+		// read the vole file at path and then remove it.
+		void load(const std::string& path);
+
+		// release the correlations once they are used.
+		void clear();
+	};
+
+	// write the sender's d and b to path, which must not exist.
+	void writeSenderVole(const std::string& path, block voleId, block d, span<const block> b, bool malicious);
+
+	// write the receiver's a and c to path, which must not exist.
+	void writeReceiverVole(const std::string& path, block voleId, span<const block> a, span<const block> c, bool malicious);
+}
@@ -15,6 +15,13 @@
 #include "SimpleIndex.h"
 #include "RsPsi.h"
 #include "RsOprf.h"
+#include "OkvsTuner.h"
+#include "BaxosDecoder.h"
+#include "OprfServer.h"
+#include "BaxosFileEncoder.h"
+#include "PaxosFile.h"
+#include <filesystem>
+#include <macoro/start_on.h>
 #include <libdivide.h>
 using namespace oc;
 using namespace volePSI;;
@@ -65,6 +72,116 @@ void testAdd(oc::CLP& cmd)
 	std::cout << "total " << tt << "ms"<< std::endl;
 }
 
+// check that encode(plan, ...) decodes to the same values as solve(...)
+// for two sets of values with the same keys, with a Paxos and a Baxos.
+template<typename T>
+void checkPlan(span<const block> key, const PaxosParam& pp, u64 binSize, u64 nt)
+{
+	auto n = key.size();
+	Paxos<T> paxos;
+	paxos.init(n, pp, oc::ZeroBlock);
+	paxos.mNumThreads = nt;
+	paxos.setInput(key);
+	auto plan = paxos.getPlan();
+
+	Baxos baxos;
+	baxos.init(n, binSize, pp.mWeight, pp.mSsp, pp.mDt, oc::ZeroBlock);
+	auto baxosPlan = baxos.getPlan(key, nt);
+
+	std::vector<block> val(n), solved(n), planned(n), pax(paxos.size()), bax(baxos.size());
+	span<const block> v(val), cp(pax), cb(bax);
+	PRNG prng(oc::OneBlock);
+	for (u64 i = 0; i < 2; ++i)
+	{
+		prng.get<block>(val);
+
+		paxos.template solve<block>(key, v, span<block>(pax));
+		paxos.template decode<block>(key, span<block>(solved), cp);
+		paxos.template encode<block>(plan, v, span<block>(pax));
+		paxos.template decode<block>(key, span<block>(planned), cp);
+		if (solved != val || planned != val)
+			throw std::runtime_error("Paxos::encode(plan, ...) does not match solve(...). " LOCATION);
+
+		baxos.solve<block>(key, v, span<block>(bax), nullptr, nt);
+		baxos.decode<block>(key, span<block>(solved), cb, nt);
+		baxos.encode<block>(baxosPlan, v, span<block>(bax), nullptr, nt);
+		baxos.decode<block>(key, span<block>(planned), cb, nt);
+		if (solved != val || planned != val)
+			throw std::runtime_error("Baxos::encode(plan, ...) does not match solve(...). " LOCATION);
+	}
+	std::cout << "plan check passed" << std::endl;
+}
+
+// check that a Baxos that is updated with update(...) decodes to the
+// same values as one solved from scratch on the updated keys, and that
+// removing a key which is not encoded throws and changes nothing.
+void checkUpdate(span<const block> key, const PaxosParam& pp, u64 binSize, u64 nt)
+{
+	auto n = key.size();
+	Baxos baxos;
+	baxos.init(n, binSize, pp.mWeight, pp.mSsp, pp.mDt, oc::ZeroBlock);
+	auto plan = baxos.getPlan(key, nt);
+
+	std::vector<block> val(n), pax(baxos.size());
+	PRNG prng(block(2, 2));
+	prng.get<block>(val);
+	baxos.encode<block>(plan, span<const block>(val), span<block>(pax), nullptr, nt);
+
+	// remove every 16th key and insert half as many new ones, so that no
+	// bin grows past its size.
+	std::vector<block> removeKeys, insertKeys(n / 32), insertVals(n / 32), newKeys, newVals;
+	prng.get<block>(insertKeys);
+	prng.get<block>(insertVals);
+	for (u64 i = 0; i < n; ++i)
+	{
+		if (i % 16 == 0)
+			removeKeys.push_back(key[i]);
+		else
+		{
+			newKeys.push_back(key[i]);
+			newVals.push_back(val[i]);
+		}
+	}
+	newKeys.insert(newKeys.end(), insertKeys.begin(), insertKeys.end());
+	newVals.insert(newVals.end(), insertVals.begin(), insertVals.end());
+
+	baxos.update<block>(plan, insertKeys, span<const block>(insertVals), removeKeys, span<block>(pax), nullptr, nt);
+
+	std::vector<block> updated(newKeys.size()), resolved(newKeys.size());
+	baxos.decode<block>(newKeys, span<block>(updated), span<const block>(pax), nt);
+
+	Baxos fresh;
+	fresh.init(newKeys.size(), binSize, pp.mWeight, pp.mSsp, pp.mDt, oc::ZeroBlock);
+	std::vector<block> freshPax(fresh.size());
+	fresh.solve<block>(newKeys, span<const block>(newVals), span<block>(freshPax), nullptr, nt);
+	fresh.decode<block>(newKeys, span<block>(resolved), span<const block>(freshPax), nt);
+	if (updated != resolved || updated != newVals)
+		throw std::runtime_error("Baxos::update(...) does not match a full solve. " LOCATION);
+
+	// the updated plan lists the kept keys in order and then the inserted
+	// ones, re-encoding with it must give the same values.
+	baxos.encode<block>(plan, span<const block>(newVals), span<block>(pax), nullptr, nt);
+	baxos.decode<block>(newKeys, span<block>(updated), span<const block>(pax), nt);
+	if (updated != newVals)
+		throw std::runtime_error("the plan of Baxos::update(...) has the wrong key order. " LOCATION);
+
+	auto before = pax;
+	auto threw = false;
+	try
+	{
+		baxos.update<block>(plan, span<const block>(), span<const block>(),
+			span<const block>(removeKeys).subspan(0, 1), span<block>(pax), nullptr, nt);
+	}
+	catch (std::exception&)
+	{
+		threw = true;
+	}
+	if (threw == false || pax != before || plan.mNumItems != newKeys.size())
+		throw std::runtime_error("Baxos::update(...) removed a key that is not encoded. " LOCATION);
+
+	std::cout << "update check passed" << std::endl;
+}
+
 template<typename T>
 void perfPaxosImpl(oc::CLP& cmd)
 {
@@ -77,6 +194,18 @@ void perfPaxosImpl(oc::CLP& cmd)
 	auto ssp = cmd.getOr("ssp", 40);
 	auto dt = cmd.isSet("binary") ? PaxosParam::Binary : PaxosParam::GF128;
 	auto cols = cmd.getOr("cols", 0);
+	auto nt = cmd.getOr("nt", 1);
+
+	// force the decode kernel, 0 scalar, 1 avx2, 2 avx512. The cpu must
+	// support it.
+	if (cmd.hasValue("isa"))
+	{
+		auto isa = cmd.get<int>("isa");
+		auto best = static_cast<int>(paxosDetectDecodeIsa());
+		if (isa < 0 || isa > best)
+			throw std::runtime_error("-isa must be in [0, " + std::to_string(best) + "] on this cpu. " LOCATION);
+		paxosDecodeIsa() = static_cast<PaxosDecodeIsa>(isa);
+	}
 
 	PaxosParam pp(n, w, ssp, dt);
 	//std::cout << "e=" << pp.size() / double(n) << std::endl;
@@ -100,6 +229,7 @@ void perfPaxosImpl(oc::CLP& cmd)
 	{
 		Paxos<T> paxos;
 		paxos.init(n, pp, block(i, i));
+		paxos.mNumThreads = nt;
 
 		if (v > 1)
 			paxos.setTimer(timer);
@@ -130,6 +260,11 @@ void perfPaxosImpl(oc::CLP& cmd)
 	std::cout << "total " << tt << "ms" << std::endl;
 	double D_size_MB = (pp.size() * m * sizeof(block)) / (1024.0 * 1024.0);
 	std::cout << "D vector size: " << D_size_MB << " MB" << std::endl;
+
+	if (cmd.isSet("plan"))
+		checkPlan<T>(key, pp, 1ull << cmd.getOr("lbs", 15), nt);
+	if (cmd.isSet("update"))
+		checkUpdate(key, pp, 1ull << cmd.getOr("lbs", 15), nt);
 }
 
 void perfPaxos(oc::CLP& cmd)
@@ -156,6 +291,198 @@ void perfPaxos(oc::CLP& cmd)
 
 }
 
+// the time of a Baxos solve and decode. With -v the time that each 
+// thread spent solving bins is printed, to see the imbalance. -numa 
+// places the bins on the numa nodes, see Baxos::mNuma. -part decodes
+// with Baxos::mPartitionDecode. -retries sets Baxos::mMaxBinRetries.
+// -decoder decodes with a single BaxosDecoder shared by the threads.
+void perfBaxos(oc::CLP& cmd)
+{
+	auto n = cmd.getOr("n", 1ull << cmd.getOr("nn", 10));
+	auto t = cmd.getOr("t", 1ull);
+	auto v = cmd.getOr("v", cmd.isSet("v") ? 1 : 0);
+	auto w = cmd.getOr("w", 3);
+	auto ssp = cmd.getOr("ssp", 40);
+	auto dt = cmd.isSet("binary") ? PaxosParam::Binary : PaxosParam::GF128;
+	auto nt = cmd.getOr("nt", 0);
+	auto binSize = 1ull << cmd.getOr("lbs", 15);
+
+	u64 baxosSize;
+	{
+		Baxos paxos;
+		paxos.init(n, binSize, w, ssp, dt, oc::ZeroBlock);
+		baxosSize = paxos.size();
+	}
+	std::vector<block> key(n), val(n), pax(baxosSize);
+	PRNG prng(ZeroBlock);
+	prng.get<block>(key);
+	prng.get<block>(val);
+
+	Timer timer;
+	auto start = timer.setTimePoint("start");
+	auto end = start;
+	for (u64 i = 0; i < t; ++i)
+	{
+		Baxos paxos;
+		paxos.init(n, binSize, w, ssp, dt, block(i, i));
+		paxos.mNuma = cmd.isSet("numa");
+		paxos.mPartitionDecode = cmd.isSet("part");
+		paxos.mMaxBinRetries = cmd.getOr("retries", 0);
+
+		paxos.solve<block>(key, val, pax, nullptr, nt);
+		timer.setTimePoint("s" + std::to_string(i));
+
+		if (v && paxos.mThrdSolveStats.size())
+		{
+			std::vector<double> ms;
+			for (auto& s : paxos.mThrdSolveStats)
+				ms.push_back(std::chrono::duration<double, std::milli>(s.mTime).count());
+			std::sort(ms.begin(), ms.end());
+			std::cout << "bin solve per thread: min " << ms.front()
+				<< "ms median " << ms[ms.size() / 2]
+				<< "ms max " << ms.back() << "ms" << std::endl;
+		}
+
+		if (cmd.isSet("decoder"))
+		{
+			BaxosDecoder decoder(paxos);
+			auto numThreads = std::max<u64>(1, nt);
+			threadPool()->run(numThreads, [&](u64 thrdIdx)
+			{
+				auto b = key.size() * thrdIdx / numThreads;
+				auto e = key.size() * (thrdIdx + 1) / numThreads;
+				decoder.decode<block>(
+					span<const block>(key).subspan(b, e - b),
+					span<block>(val).subspan(b, e - b),
+					pax);
+			});
+		}
+		else
+			paxos.decode<block>(key, val, pax, nt);
+
+		end = timer.setTimePoint("d" + std::to_string(i));
+	}
+
+	if (v)
+		std::cout << timer << std::endl;
+
+	auto tt = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / double(1000);
+	std::cout << "total " << tt << "ms, e=" << double(baxosSize) / n << std::endl;
+}
+
+// encode a Baxos to a file with BaxosFileEncoder under a small memory
+// budget, so that the keys are split into several partitions, and check
+// that the mapped file decodes to the values. Runs once without and once
+// with bin retries.
+void perfFileEncode(oc::CLP& cmd)
+{
+	auto n = cmd.getOr("n", 1ull << cmd.getOr("nn", 16));
+	auto w = cmd.getOr("w", 3);
+	auto ssp = cmd.getOr("ssp", 40);
+	auto nt = cmd.getOr("nt", 1);
+	auto binSize = 1ull << cmd.getOr("lbs", 10);
+	auto mem = cmd.getOr("mem", 1ull << 20);
+	auto retries = cmd.getOr("retries", 4ull);
+	auto dir = std::filesystem::temp_directory_path() / "baxosFileEncode";
+	auto outPath = (dir / "baxos.bin").string();
+	std::filesystem::create_directories(dir);
+
+	std::vector<block> key(n), val(n), out(n);
+	PRNG prng(ZeroBlock);
+	prng.get<block>(key);
+	prng.get<block>(val);
+
+	for (auto maxRetries : { 0ull, retries })
+	{
+		Baxos baxos;
+		baxos.init(n, binSize, w, ssp, PaxosParam::GF128, block(maxRetries, 1));
+		baxos.mMaxBinRetries = maxRetries;
+
+		auto begin = std::chrono::steady_clock::now();
+		BaxosFileEncoder encoder;
+		encoder.init(baxos, 1, outPath, dir.string(), mem);
+		for (u64 i = 0; i < n; i += 4096)
+		{
+			auto m = std::min<u64>(4096, n - i);
+			encoder.add(span<const block>(key).subspan(i, m), span<const block>(val).subspan(i, m));
+		}
+		encoder.finish(nullptr, nt);
+		auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		MappedPaxosFile file(outPath);
+		Baxos decoder;
+		file.init(decoder);
+		decoder.decode<block>(key, span<block>(out), file.p<block>(), nt);
+		if (out != val)
+			throw std::runtime_error("the paxos file decoded the wrong value. " LOCATION);
+
+		std::cout << "file encode of " << n << " keys, retries " << maxRetries
+			<< ": " << ms << "ms, " << file.header().mNumItems << " items, ok" << std::endl;
+	}
+
+	std::filesystem::remove_all(dir);
+}
+
+// the latency of point lookups. Each query decodes -b random keys 
+// (1 to 32) with a BaxosDecoder, or with Baxos::decode if -baxos is set.
+void perfLookup(oc::CLP& cmd)
+{
+	auto n = cmd.getOr("n", 1ull << cmd.getOr("nn", 20));
+	auto q = cmd.getOr("q", 1ull << 16);
+	auto batch = cmd.getOr("b", 1ull);
+	auto w = cmd.getOr("w", 3);
+	auto ssp = cmd.getOr("ssp", 40);
+	auto dt = cmd.isSet("binary") ? PaxosParam::Binary : PaxosParam::GF128;
+	auto binSize = 1ull << cmd.getOr("lbs", 15);
+	auto useBaxos = cmd.isSet("baxos");
+	if (batch == 0 || batch > Baxos::smallDecodeSize || batch > n)
+		throw std::runtime_error("-b must be in [1, 32] and at most n. " LOCATION);
+	if (q == 0)
+		throw std::runtime_error("-q must be at least 1. " LOCATION);
+
+	Baxos baxos;
+	baxos.init(n, binSize, w, ssp, dt, oc::ZeroBlock);
+	std::vector<block> key(n), val(n), pax(baxos.size());
+	PRNG prng(ZeroBlock);
+	prng.get<block>(key);
+	prng.get<block>(val);
+	baxos.solve<block>(key, val, pax, nullptr, cmd.getOr("nt", 1));
+
+	BaxosDecoder decoder(baxos);
+	std::array<block, Baxos::smallDecodeSize> out;
+	std::vector<u64> begins(q);
+	for (auto& b : begins)
+		b = prng.get<u64>() % (n - batch + 1);
+
+	std::vector<double> ns(q);
+	for (u64 i = 0; i < q; ++i)
+	{
+		span<const block> in(key.data() + begins[i], batch);
+		span<block> o(out.data(), batch);
+
+		auto t0 = std::chrono::steady_clock::now();
+		if (useBaxos)
+			baxos.decode<block>(in, o, pax, 1);
+		else
+			decoder.decode<block>(in, o, pax);
+		auto t1 = std::chrono::steady_clock::now();
+		ns[i] = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+		for (u64 j = 0; j < batch; ++j)
+			if (out[j] != val[begins[i] + j])
+				throw std::runtime_error("lookup decoded the wrong value. " LOCATION);
+	}
+
+	auto mean = std::accumulate(ns.begin(), ns.end(), 0.0) / q;
+	std::sort(ns.begin(), ns.end());
+	auto at = [&](double f) { return ns[std::min<u64>(q - 1, u64(f * q))]; };
+	std::cout << (useBaxos ? "Baxos::decode" : "BaxosDecoder") << " batch " << batch
+		<< ", " << q << " queries: p50 " << at(0.5)
+		<< "ns p99 " << at(0.99)
+		<< "ns p99.9 " << at(0.999)
+		<< "ns mean " << mean << "ns" << std::endl;
+}
+
 void perfOPRF(oc::CLP& cmd)
 {
     // 基本参数设置（从perfPSI中提取）
@@ -164,6 +491,14 @@ void perfOPRF(oc::CLP& cmd)
     auto v = cmd.isSet("v") ? cmd.getOr("v", 1) : 0;
     auto nt = cmd.getOr("nt", 1);
     bool fakeBase = cmd.isSet("fakeBase");
+
+    // generate the voles in an offline phase before each trial, store 
+    // them in files and have send/receive load them. The outputs are 
+    // checked against the sender's eval(...).
+    bool offline = cmd.isSet("offline");
+    auto voleDir = std::filesystem::temp_directory_path();
+    auto senderVole = (voleDir / "oprfSenderVole.bin").string();
+    auto recverVole = (voleDir / "oprfRecverVole.bin").string();
     
     // VOLE类型设置
     auto type = oc::DefaultMultType;
@@ -179,6 +514,7 @@ void perfOPRF(oc::CLP& cmd)
     
     std::cout << "OPRF Performance Test: nt=" << nt 
               << " fakeBase=" << int(fakeBase) 
+              << " offline=" << int(offline)
               << " n=" << n << std::endl;
 
     // 创建OPRF实例（而非完整PSI）
@@ -192,6 +528,17 @@ void perfOPRF(oc::CLP& cmd)
         oprfRecv.mBinSize = binSize;
         oprfSend.mBinSize = binSize;
     }
+    else if (cmd.isSet("tune")) {
+        // benchmark the bin size and weight on this machine.
+        OkvsTuner tuner;
+        tuner.mVerbose = v > 0;
+        auto config = tuner.tune(n, nt, PaxosParam::GF128);
+        std::cout << "tuned w=" << config.mWeight
+                  << " binSize=" << config.mBinSize
+                  << " idx=" << config.mIdxBytes << std::endl;
+        oprfRecv.mBinSize = oprfSend.mBinSize = config.mBinSize;
+        oprfRecv.mWeight = oprfSend.mWeight = config.mWeight;
+    }
     
     // 设置VOLE类型
     oprfRecv.setMultType(type);
@@ -215,6 +562,21 @@ void perfOPRF(oc::CLP& cmd)
     // 运行OPRF测试
     for (u64 i = 0; i < t; ++i) {
         timer.setTimePoint("trial_" + std::to_string(i) + "_begin");
+
+        if (offline) {
+            // the files must not exist, loadVole removes them.
+            std::filesystem::remove(senderVole);
+            std::filesystem::remove(recverVole);
+            auto offlineResults = macoro::sync_wait(macoro::when_all_ready(
+                oprfRecv.offline(n, prng, sockets[0], recverVole),
+                oprfSend.offline(n, prng, sockets[1], senderVole)));
+            std::get<0>(offlineResults).result();
+            std::get<1>(offlineResults).result();
+
+            oprfRecv.loadVole(recverVole);
+            oprfSend.loadVole(senderVole);
+            timer.setTimePoint("trial_" + std::to_string(i) + "_offline");
+        }
         
         // 记录OPRF开始时间
         oprfStarts[i] = std::chrono::high_resolution_clock::now();
@@ -246,6 +608,17 @@ void perfOPRF(oc::CLP& cmd)
         } catch(std::exception& e) {
             std::cout << "Sender error: " << e.what() << std::endl; 
         }
+
+        if (offline) {
+            // the stored voles are used once and their files are gone.
+            std::vector<block> senderOutputs(n);
+            oprfSend.eval(receiverInputs, senderOutputs, nt);
+            if (senderOutputs != oprfOutputs)
+                throw std::runtime_error("the offline oprf has the wrong output. " LOCATION);
+            if (oprfSend.mStoredVole.loaded() || oprfRecv.mStoredVole.loaded() ||
+                std::filesystem::exists(senderVole) || std::filesystem::exists(recverVole))
+                throw std::runtime_error("a stored vole was not used up. " LOCATION);
+        }
         
         timer.setTimePoint("trial_" + std::to_string(i) + "_end");
     }
@@ -300,6 +673,94 @@ void perfOPRF(oc::CLP& cmd)
         }
     }
 }
+// one receiver session against the server over a local socket pair.
+Proto serveLoopback(OprfServer& server, RsOprfReceiver& recver, span<const block> recvKeys, span<block> recvOut,
+	span<const block> serverKeys, span<block> serverOut, block seed, double& ms)
+{
+	auto sockets = cp::LocalAsyncSocket::makePair();
+	auto prng = PRNG(seed);
+	auto begin = std::chrono::steady_clock::now();
+
+	auto results = co_await(macoro::when_all_ready(
+		recver.receive(recvKeys, recvOut, prng, sockets[0]),
+		server.serve(recvKeys.size(), serverKeys, serverOut, sockets[1], seed ^ oc::OneBlock)));
+	std::get<0>(results).result();
+	std::get<1>(results).result();
+
+	ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// -s concurrent receiver sessions (1 to 256) of 2^nn keys each against
+// one OprfServer with 2^snn keys, all on an executor with -nt threads.
+void perfServer(oc::CLP& cmd)
+{
+	auto numSessions = cmd.getOr("s", 16ull);
+	auto n = 1ull << cmd.getOr("nn", 14);
+	auto sn = 1ull << cmd.getOr("snn", 14);
+	auto nt = cmd.getOr("nt", std::max<u64>(1, std::thread::hardware_concurrency()));
+	if (numSessions == 0 || numSessions > 256)
+		throw std::runtime_error("-s must be in [1, 256]. " LOCATION);
+
+	macoro::thread_pool executor;
+	auto work = executor.make_work();
+	executor.create_threads(nt);
+
+	OprfServer server(executor);
+	server.mMaxSessions = cmd.getOr("max", server.mMaxSessions);
+	server.mMemoryBudget = cmd.getOr("mem", server.mMemoryBudget >> 20) << 20;
+	server.mSessionThreads = cmd.getOr("st", 1ull);
+	server.mMaxVoleParts = cmd.getOr("vp", server.mMaxVoleParts);
+
+	PRNG prng(ZeroBlock);
+	std::vector<block> serverKeys(sn);
+	prng.get<block>(serverKeys);
+
+	std::vector<RsOprfReceiver> recvers(numSessions);
+	std::vector<std::vector<block>> recvKeys(numSessions), recvOut(numSessions), serverOut(numSessions);
+	std::vector<double> ms(numSessions);
+	std::vector<macoro::eager_task<void>> tasks;
+	for (u64 i = 0; i < numSessions; ++i)
+	{
+		recvKeys[i].resize(n);
+		recvOut[i].resize(n);
+		serverOut[i].resize(sn);
+		prng.get<block>(recvKeys[i]);
+		recvers[i].mExecutor = &executor;
+
+		// half of the keys are in the server's set.
+		std::copy(serverKeys.begin(), serverKeys.begin() + std::min(n, sn) / 2, recvKeys[i].begin());
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	for (u64 i = 0; i < numSessions; ++i)
+		tasks.push_back(serveLoopback(server, recvers[i], recvKeys[i], recvOut[i], serverKeys, serverOut[i], prng.get(), ms[i])
+			| macoro::start_on(executor)
+			| macoro::make_eager());
+
+	u64 failed = 0;
+	for (auto& t : tasks)
+	{
+		try { macoro::sync_wait(std::move(t)); }
+		catch (std::exception& e) { ++failed; std::cout << "session error: " << e.what() << std::endl; }
+	}
+	auto total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	// the shared keys must have the same oprf value on both sides.
+	for (u64 i = 0; i < numSessions && failed == 0; ++i)
+		for (u64 j = 0; j < std::min(n, sn) / 2; ++j)
+			if (recvOut[i][j] != serverOut[i][j])
+				throw std::runtime_error("server session " + std::to_string(i) + " has the wrong oprf value. " LOCATION);
+
+	std::sort(ms.begin(), ms.end());
+	std::cout << numSessions << " sessions of 2^" << oc::log2ceil(n) << " keys, " << nt << " threads: total "
+		<< total << "ms, " << numSessions * 1000.0 / total << " sessions/s, latency p50 "
+		<< ms[numSessions / 2] << "ms max " << ms.back() << "ms, peak " << server.peakSessions()
+		<< " concurrent, " << failed << " failed" << std::endl;
+
+	work.reset();
+	executor.join();
+}
+
 int main(int argc, char** argv){
     CLP cmd;
     cmd.parse(argc, argv);
@@ -309,6 +770,14 @@ int main(int argc, char** argv){
         testGen(cmd);
     } else if (cmd.isSet("oprf")) {
         perfOPRF(cmd);
+    } else if (cmd.isSet("lookup")) {
+        perfLookup(cmd);
+    } else if (cmd.isSet("baxos")) {
+        perfBaxos(cmd);
+    } else if (cmd.isSet("file")) {
+        perfFileEncode(cmd);
+    } else if (cmd.isSet("server")) {
+        perfServer(cmd);
     } else {
         testAdd(cmd);
     }